@@ -3,8 +3,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <bench/bench.h>
+#include <chainparams.h>
 #include <consensus/validation.h>
 #include <crypto/sha256.h>
+#include <miner.h>
+#include <script/interpreter.h>
 #include <test/util/mining.h>
 #include <test/util/setup_common.h>
 #include <test/util/wallet.h>
@@ -59,4 +62,85 @@ static void AssembleBlock(benchmark::Bench& bench)
     });
 }
 
+// Refresh the block template after a transaction arrived in a mempool of a
+// few thousand transactions, either by assembling a new block from scratch or
+// by letting the same BlockAssembler update its previous template.
+static void AssembleBlockRefresh(benchmark::Bench& bench, bool incremental)
+{
+    TestChain100Setup test_setup;
+    CTxMemPool& pool{*test_setup.m_node.mempool};
+
+    const std::vector<unsigned char> op_true{OP_TRUE};
+    CScriptWitness witness;
+    witness.stack.push_back(op_true);
+
+    uint256 witness_program;
+    CSHA256().Write(&op_true[0], op_true.size()).Finalize(witness_program.begin());
+
+    const CScript SCRIPT_PUB{CScript(OP_0) << std::vector<unsigned char>{witness_program.begin(), witness_program.end()}};
+    const CScript p2pk{CScript() << ToByteVector(test_setup.coinbaseKey.GetPubKey()) << OP_CHECKSIG};
+
+    // Fan mature coinbases out to many outputs in blocks, so that the children
+    // spending them have no unconfirmed ancestors and are not bound by the
+    // mempool package limits
+    constexpr int NUM_FANOUT_BLOCKS{20};
+    constexpr int NUM_OUTPUTS{100};
+    constexpr size_t NUM_INITIAL_CHILDREN{1500};
+    constexpr CAmount CHILD_FEE{1000};
+    std::vector<CTransactionRef> children;
+    for (int i = 0; i < NUM_FANOUT_BLOCKS; ++i) {
+        const CTransactionRef& coinbase = test_setup.m_coinbase_txns[i];
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(coinbase->GetHash(), 0));
+        const CAmount value = (coinbase->vout[0].nValue - 1000) / NUM_OUTPUTS;
+        tx.vout.resize(NUM_OUTPUTS, CTxOut{value, SCRIPT_PUB});
+        std::vector<unsigned char> vchSig;
+        const uint256 hash = SignatureHash(p2pk, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        bool signed_tx{test_setup.coinbaseKey.Sign(hash, vchSig)};
+        assert(signed_tx);
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        test_setup.CreateAndProcessBlock({tx}, p2pk);
+
+        for (uint32_t n = 0; n < NUM_OUTPUTS; ++n) {
+            CMutableTransaction child;
+            child.vin.emplace_back(COutPoint{tx.GetHash(), n});
+            child.vin.back().scriptWitness = witness;
+            child.vout.emplace_back(value - CHILD_FEE, SCRIPT_PUB);
+            children.push_back(MakeTransactionRef(child));
+        }
+    }
+    {
+        LOCK(::cs_main); // Required for ::AcceptToMemoryPool.
+
+        for (size_t i{0}; i < NUM_INITIAL_CHILDREN; ++i) {
+            TxValidationState state;
+            bool ret{::AcceptToMemoryPool(pool, state, children[i], nullptr /* plTxnReplaced */, false /* bypass_limits */)};
+            assert(ret);
+        }
+    }
+
+    BlockAssembler assembler{pool, Params()};
+    assembler.CreateNewBlock(SCRIPT_PUB);
+
+    // Each iteration adds one more child, so the number of iterations is
+    // bounded by the children left to add
+    size_t next_child{NUM_INITIAL_CHILDREN};
+    bench.epochs(5).epochIterations(100).run([&] {
+        assert(next_child < children.size());
+        {
+            LOCK2(::cs_main, pool.cs);
+            LockPoints lp;
+            pool.addUnchecked(CTxMemPoolEntry(children[next_child++], CHILD_FEE, /* time */ 0, /* entry_height */ 1, /* spends_coinbase */ false, /* sigops_cost */ 0, lp));
+        }
+        std::unique_ptr<CBlockTemplate> block_template{incremental ? assembler.CreateNewBlock(SCRIPT_PUB) : BlockAssembler{pool, Params()}.CreateNewBlock(SCRIPT_PUB)};
+        assert(block_template->block.vtx.size() == next_child + 1);
+    });
+}
+
+static void AssembleBlockRefreshFull(benchmark::Bench& bench) { AssembleBlockRefresh(bench, /* incremental */ false); }
+static void AssembleBlockRefreshIncremental(benchmark::Bench& bench) { AssembleBlockRefresh(bench, /* incremental */ true); }
+
 BENCHMARK(AssembleBlock);
+BENCHMARK(AssembleBlockRefreshFull);
+BENCHMARK(AssembleBlockRefreshIncremental);
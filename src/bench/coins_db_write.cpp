@@ -0,0 +1,52 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <coins.h>
+#include <random.h>
+#include <txdb.h>
+
+// Write a few cache flushes worth of new coins into an empty coin database,
+// the way -reindex-chainstate fills it.
+static void WriteCoinsToDB(benchmark::Bench& bench, bool bulk_load)
+{
+    static constexpr size_t NUM_FLUSHES{8};
+    static constexpr size_t COINS_PER_FLUSH{20000};
+
+    FastRandomContext rng(/* fDeterministic */ true);
+    Coin coin;
+    coin.nHeight = 1;
+    coin.out.nValue = 50 * COIN;
+    coin.out.scriptPubKey.assign(25U, uint8_t{0x51});
+
+    bench.epochs(5).epochIterations(1).run([&] {
+        CCoinsViewDB db{"bench", nMaxCoinsDBCache << 20, /* fMemory */ true, /* fWipe */ true};
+        if (bulk_load) db.StartBulkLoad();
+        for (size_t i = 0; i < NUM_FLUSHES; ++i) {
+            CCoinsMapMemoryResource resource;
+            CCoinsMap map{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, &resource};
+            for (size_t n = 0; n < COINS_PER_FLUSH; ++n) {
+                CCoinsCacheEntry& entry = map[COutPoint{rng.rand256(), 0}];
+                entry.coin = coin;
+                entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+            }
+            bool written = db.BatchWrite(map, rng.rand256());
+            assert(written);
+        }
+        if (bulk_load) db.FinishBulkLoad();
+    });
+}
+
+static void CoinsDBWrite(benchmark::Bench& bench)
+{
+    WriteCoinsToDB(bench, /* bulk_load */ false);
+}
+
+static void CoinsDBBulkLoad(benchmark::Bench& bench)
+{
+    WriteCoinsToDB(bench, /* bulk_load */ true);
+}
+
+BENCHMARK(CoinsDBWrite);
+BENCHMARK(CoinsDBBulkLoad);
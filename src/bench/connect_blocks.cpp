@@ -0,0 +1,82 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chainparams.h>
+#include <consensus/consensus.h>
+#include <consensus/validation.h>
+#include <script/interpreter.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+
+#include <vector>
+
+// Synthetic initial block download: blocks that are already stored on disk are
+// connected one after the other through ActivateBestChain, reading each block
+// back from disk, so the block read-ahead, input prefetch and script-check
+// stages all take part. Every iteration first disconnects the same blocks
+// again, which is included in the measurement.
+static void ConnectBlocks(benchmark::Bench& bench)
+{
+    TestChain100Setup test_setup;
+
+    // Fan each mature coinbase out to many outputs, then spend all of those
+    // outputs again in a later block, so blocks have both signature checks and
+    // plenty of inputs to look up.
+    constexpr int NUM_FANOUT_BLOCKS{50};
+    constexpr int NUM_OUTPUTS{20};
+    const CScript p2pk{CScript() << ToByteVector(test_setup.coinbaseKey.GetPubKey()) << OP_CHECKSIG};
+    const CScript op_true{CScript() << OP_TRUE};
+
+    std::vector<CTransactionRef> fanouts;
+    for (int i = 0; i < NUM_FANOUT_BLOCKS; ++i) {
+        const CTransactionRef& coinbase = test_setup.m_coinbase_txns[i];
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint(coinbase->GetHash(), 0));
+        const CAmount value = (coinbase->vout[0].nValue - 1000) / NUM_OUTPUTS;
+        for (int j = 0; j < NUM_OUTPUTS; ++j) {
+            tx.vout.emplace_back(value, op_true);
+        }
+        std::vector<unsigned char> vchSig;
+        const uint256 hash = SignatureHash(p2pk, tx, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+        assert(test_setup.coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        tx.vin[0].scriptSig << vchSig;
+        fanouts.push_back(MakeTransactionRef(tx));
+        test_setup.CreateAndProcessBlock({tx}, p2pk);
+    }
+    for (const CTransactionRef& fanout : fanouts) {
+        CMutableTransaction tx;
+        for (int j = 0; j < NUM_OUTPUTS; ++j) {
+            tx.vin.emplace_back(COutPoint(fanout->GetHash(), j));
+        }
+        tx.vout.emplace_back(fanout->vout[0].nValue * (NUM_OUTPUTS - 1), op_true);
+        test_setup.CreateAndProcessBlock({tx}, p2pk);
+    }
+
+    const CChainParams& chainparams = Params();
+    CBlockIndex* first;
+    CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = ::ChainActive().Tip();
+        assert(tip->nHeight == COINBASE_MATURITY + 2 * NUM_FANOUT_BLOCKS);
+        first = ::ChainActive()[COINBASE_MATURITY + 1];
+    }
+
+    bench.batch(2 * NUM_FANOUT_BLOCKS).unit("block").run([&] {
+        BlockValidationState state;
+        bool invalidated = InvalidateBlock(state, chainparams, first);
+        assert(invalidated);
+        {
+            LOCK(cs_main);
+            ResetBlockFailureFlags(first);
+        }
+        bool activated = ActivateBestChain(state, chainparams);
+        assert(activated);
+        assert(WITH_LOCK(cs_main, return ::ChainActive().Tip()) == tip);
+    });
+}
+
+BENCHMARK(ConnectBlocks);
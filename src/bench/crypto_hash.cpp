@@ -71,6 +71,40 @@ static void SHA256D64_1024(benchmark::Bench& bench)
     });
 }
 
+// Double hashes of 1000 messages of transaction-like sizes.
+static void SHA256DMessages(benchmark::Bench& bench, bool batch)
+{
+    static constexpr size_t COUNT{1000};
+    FastRandomContext rng(true);
+    std::vector<uint8_t> in(COUNT * 500, 0);
+    std::vector<const uint8_t*> inputs(COUNT);
+    std::vector<size_t> lengths(COUNT);
+    for (size_t i = 0; i < COUNT; ++i) {
+        inputs[i] = in.data() + 500 * i;
+        lengths[i] = 150 + rng.randrange(350);
+    }
+    std::vector<uint8_t> out(COUNT * CSHA256::OUTPUT_SIZE);
+    bench.batch(COUNT).unit("message").run([&] {
+        if (batch) {
+            SHA256DBatch(out.data(), inputs.data(), lengths.data(), COUNT);
+        } else {
+            for (size_t i = 0; i < COUNT; ++i) {
+                CHash256().Write({inputs[i], lengths[i]}).Finalize({out.data() + i * CSHA256::OUTPUT_SIZE, CSHA256::OUTPUT_SIZE});
+            }
+        }
+    });
+}
+
+static void SHA256D_1000(benchmark::Bench& bench)
+{
+    SHA256DMessages(bench, /* batch */ false);
+}
+
+static void SHA256DBatch_1000(benchmark::Bench& bench)
+{
+    SHA256DMessages(bench, /* batch */ true);
+}
+
 static void SHA512(benchmark::Bench& bench)
 {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
@@ -114,5 +148,7 @@ BENCHMARK(SHA3_256_1M);
 BENCHMARK(SHA256_32b);
 BENCHMARK(SipHash_32b);
 BENCHMARK(SHA256D64_1024);
+BENCHMARK(SHA256D_1000);
+BENCHMARK(SHA256DBatch_1000);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
@@ -91,4 +91,40 @@ static void ComplexMemPool(benchmark::Bench& bench)
     });
 }
 
+static void MempoolChainRemoveForBlock(benchmark::Bench& bench)
+{
+    // A long CPFP chain of which all but the last few transactions are
+    // confirmed in a single block.
+    const int chain_length = 500;
+    const int unconfirmed = 10;
+    std::vector<CTransactionRef> chain;
+    for (int i = 0; i < chain_length; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (chain.empty()) {
+            tx.vin[0].scriptSig = CScript() << OP_1;
+        } else {
+            tx.vin[0].prevout = COutPoint(chain.back()->GetHash(), 0);
+        }
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << CScriptNum(i) << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        chain.push_back(MakeTransactionRef(tx));
+    }
+    const std::vector<CTransactionRef> block(chain.begin(), chain.end() - unconfirmed);
+
+    TestingSetup test_setup;
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    bench.run([&]() NO_THREAD_SAFETY_ANALYSIS {
+        for (auto& tx : chain) {
+            AddTx(tx, pool);
+        }
+        pool.removeForBlock(block, 1);
+        assert(pool.mapTx.size() == unconfirmed);
+        pool.clear();
+    });
+}
+
 BENCHMARK(ComplexMemPool);
+BENCHMARK(MempoolChainRemoveForBlock);
@@ -5,6 +5,7 @@
 #include <bench/bench.h>
 
 #include <consensus/merkle.h>
+#include <primitives/block.h>
 #include <random.h>
 #include <uint256.h>
 
@@ -23,4 +24,46 @@ static void MerkleRoot(benchmark::Bench& bench)
     });
 }
 
+// Hash the transactions of a block and compute its merkle root, as done after
+// receiving or reading the block.
+static void HashTransactionsAndMerkleRoot(benchmark::Bench& bench, bool batch)
+{
+    FastRandomContext rng(true);
+    std::vector<CMutableTransaction> txs(2000);
+    for (auto& tx : txs) {
+        tx.vin.resize(2);
+        for (auto& in : tx.vin) {
+            in.prevout = COutPoint{rng.rand256(), 0};
+            in.scriptSig.assign(107U, uint8_t{0x51});
+        }
+        tx.vout.resize(2);
+        for (auto& out : tx.vout) {
+            out.nValue = rng.randrange(COIN);
+            out.scriptPubKey.assign(25U, uint8_t{0x51});
+        }
+    }
+    bench.batch(txs.size()).unit("tx").run([&] {
+        CBlock block;
+        for (const auto& tx : txs) block.vtx.push_back(MakeTransactionRef(tx));
+        if (!batch) {
+            for (const auto& tx : block.vtx) tx->GetHash();
+        }
+        bool mutation = false;
+        uint256 hash = BlockMerkleRoot(block, &mutation);
+        assert(!hash.IsNull() && !mutation);
+    });
+}
+
+static void MerkleRootFromTransactions(benchmark::Bench& bench)
+{
+    HashTransactionsAndMerkleRoot(bench, /* batch */ false);
+}
+
+static void MerkleRootFromTransactionsBatched(benchmark::Bench& bench)
+{
+    HashTransactionsAndMerkleRoot(bench, /* batch */ true);
+}
+
 BENCHMARK(MerkleRoot);
+BENCHMARK(MerkleRootFromTransactions);
+BENCHMARK(MerkleRootFromTransactionsBatched);
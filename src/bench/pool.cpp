@@ -0,0 +1,46 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <coins.h>
+#include <support/allocators/pool.h>
+
+#include <unordered_map>
+
+// Fill a map shaped like the coins cache and empty it again, the way the
+// chainstate cache is filled during IBD and emptied by a flush.
+template <typename Map>
+static void FillAndClear(Map& map, uint256& txid)
+{
+    Coin coin;
+    coin.out.nValue = 1;
+    coin.out.scriptPubKey.assign(25U, uint8_t{0x51});
+    for (uint32_t n = 0; n < 5000; ++n) {
+        txid.begin()[n % 32] ^= uint8_t(n);
+        map[COutPoint{txid, n}].coin = coin;
+    }
+    map.clear();
+}
+
+static void CoinsMapStdAllocator(benchmark::Bench& bench)
+{
+    std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> map;
+    uint256 txid;
+    bench.run([&] {
+        FillAndClear(map, txid);
+    });
+}
+
+static void CoinsMapPoolAllocator(benchmark::Bench& bench)
+{
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, &resource};
+    uint256 txid;
+    bench.run([&] {
+        FillAndClear(map, txid);
+    });
+}
+
+BENCHMARK(CoinsMapStdAllocator);
+BENCHMARK(CoinsMapPoolAllocator);
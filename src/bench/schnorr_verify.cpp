@@ -0,0 +1,78 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <key.h>
+#include <pubkey.h>
+#include <random.h>
+#include <uint256.h>
+
+#include <secp256k1.h>
+#include <secp256k1_extrakeys.h>
+#include <secp256k1_schnorrsig.h>
+
+#include <cassert>
+#include <vector>
+
+// Number of signatures verified per iteration, about what a worker thread
+// picks up from the script check queue at once
+static constexpr size_t NUM_SIGS{128};
+
+struct SchnorrSigs {
+    std::vector<XOnlyPubKey> pubkeys;
+    std::vector<uint256> msgs;
+    std::vector<std::vector<unsigned char>> sigs;
+};
+
+static SchnorrSigs CreateSigs()
+{
+    SchnorrSigs ret;
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+    for (size_t i = 0; i < NUM_SIGS; ++i) {
+        const uint256 seckey = GetRandHash();
+        secp256k1_keypair keypair;
+        assert(secp256k1_keypair_create(ctx, &keypair, seckey.begin()));
+        secp256k1_xonly_pubkey pubkey;
+        assert(secp256k1_keypair_xonly_pub(ctx, &pubkey, nullptr, &keypair));
+        unsigned char pubkey_bytes[32];
+        assert(secp256k1_xonly_pubkey_serialize(ctx, pubkey_bytes, &pubkey));
+        const uint256 msg = GetRandHash();
+        std::vector<unsigned char> sig(64);
+        assert(secp256k1_schnorrsig_sign(ctx, sig.data(), msg.begin(), &keypair, nullptr, nullptr));
+        ret.pubkeys.emplace_back(pubkey_bytes);
+        ret.msgs.push_back(msg);
+        ret.sigs.push_back(std::move(sig));
+    }
+    secp256k1_context_destroy(ctx);
+    return ret;
+}
+
+static void SchnorrVerifySingle(benchmark::Bench& bench)
+{
+    const ECCVerifyHandle verify_handle;
+    const SchnorrSigs sigs = CreateSigs();
+    bench.unit("sig").batch(NUM_SIGS).run([&] {
+        for (size_t i = 0; i < NUM_SIGS; ++i) {
+            bool ok = sigs.pubkeys[i].VerifySchnorr(sigs.msgs[i], sigs.sigs[i]);
+            assert(ok);
+        }
+    });
+}
+
+static void SchnorrVerifyBatch(benchmark::Bench& bench)
+{
+    const ECCVerifyHandle verify_handle;
+    const SchnorrSigs sigs = CreateSigs();
+    bench.unit("sig").batch(NUM_SIGS).run([&] {
+        BatchSchnorrVerifier batch;
+        for (size_t i = 0; i < NUM_SIGS; ++i) {
+            batch.Add(sigs.pubkeys[i], sigs.msgs[i], sigs.sigs[i]);
+        }
+        bool ok = batch.Verify();
+        assert(ok);
+    });
+}
+
+BENCHMARK(SchnorrVerifySingle);
+BENCHMARK(SchnorrVerifyBatch);
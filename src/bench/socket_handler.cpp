@@ -0,0 +1,107 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <compat.h>
+#include <net.h>
+#include <netbase.h>
+#include <netmessagemaker.h>
+#include <test/util/net.h>
+#include <test/util/setup_common.h>
+#include <util/system.h>
+
+#ifdef USE_EPOLL
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+static constexpr int NUM_PEERS{5000};
+
+// Drive the socket handler with many connected loopback peers of which only
+// one sends a message per iteration, which is what a busy public node looks
+// like: most inbound peers are idle at any given wakeup.
+static void SocketHandlerLoopback(benchmark::Bench& bench, SocketEventsMode mode)
+{
+    BasicTestingSetup test_setup{
+        CBaseChainParams::REGTEST,
+        /* extra_args */ {
+            "-nodebuglogfile",
+            "-nodebug",
+        },
+    };
+
+    // Each peer takes two file descriptors, one for either end
+    const int fd_limit = RaiseFileDescriptorLimit(2 * NUM_PEERS + 64);
+    const int num_peers = std::min(NUM_PEERS, (fd_limit - 64) / 2);
+
+    ConnmanTestMsg connman{0x1337, 0x1337};
+    CConnman::Options options;
+    options.m_socket_events_mode = mode;
+    options.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+    connman.Init(options);
+
+    SOCKET listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    assert(listen_socket != INVALID_SOCKET);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    assert(bind(listen_socket, (struct sockaddr*)&addr, addr_len) == 0);
+    assert(listen(listen_socket, SOMAXCONN) == 0);
+    assert(getsockname(listen_socket, (struct sockaddr*)&addr, &addr_len) == 0);
+
+    std::vector<SOCKET> clients;
+    std::vector<CNode*> nodes;
+    for (int i = 0; i < num_peers; ++i) {
+        SOCKET client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        assert(client != INVALID_SOCKET);
+        assert(connect(client, (struct sockaddr*)&addr, addr_len) == 0);
+        SetSocketNoDelay(client);
+        SOCKET server = accept(listen_socket, nullptr, nullptr);
+        assert(server != INVALID_SOCKET);
+        CNode* node = new CNode(i, NODE_NETWORK, 0, server, CAddress{}, 0, 0, CAddress{}, std::string{}, ConnectionType::INBOUND);
+        connman.AddTestNode(*node);
+        clients.push_back(client);
+        nodes.push_back(node);
+    }
+    CloseSocket(listen_socket);
+
+    // Drain the initial writability events of all peers before measuring
+    for (int i = 0; i < num_peers / 1000 + 2; ++i) {
+        connman.SocketHandlerOnce();
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::PING, uint64_t{0});
+    std::vector<unsigned char> wire;
+    nodes[0]->m_serializer->prepareForTransport(msg, wire);
+    wire.insert(wire.end(), msg.data.begin(), msg.data.end());
+
+    size_t peer = 0;
+    bench.minEpochIterations(10).unit("wakeup").run([&] {
+        CNode* node = nodes[peer];
+        auto ret = send(clients[peer], wire.data(), wire.size(), 0);
+        assert(ret == (ssize_t)wire.size());
+        connman.SocketHandlerOnce();
+
+        LOCK(node->cs_vProcessMsg);
+        assert(node->vProcessMsg.size() == 1);
+        node->vProcessMsg.clear();
+        node->nProcessQueueSize = 0;
+        peer = (peer + 1) % nodes.size();
+    });
+
+    connman.ClearTestNodes();
+    for (SOCKET client : clients) {
+        CloseSocket(client);
+    }
+}
+
+static void SocketHandlerPoll(benchmark::Bench& bench) { SocketHandlerLoopback(bench, SocketEventsMode::POLL); }
+static void SocketHandlerEpoll(benchmark::Bench& bench) { SocketHandlerLoopback(bench, SocketEventsMode::EPOLL); }
+
+BENCHMARK(SocketHandlerPoll);
+BENCHMARK(SocketHandlerEpoll);
+#endif // USE_EPOLL
@@ -620,6 +620,13 @@ public:
             }
         };
 
+        m_assumeutxo_data = MapAssumeutxo{
+            {
+                110,
+                {uint256S("0x2be0dec7330b85a6d272f88e473e3f2c4f132c9f7e2e83d026d7a36984a7768a"), 111},
+            },
+        };
+
         chainTxData = ChainTxData{
             0,
             0,
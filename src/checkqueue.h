@@ -16,6 +16,20 @@
 template <typename T>
 class CCheckQueueControl;
 
+/**
+ * Run a group of verifications that one thread took from a CCheckQueue, until
+ * one of them fails. Verification types can specialize this to share work
+ * between the verifications of a group.
+ */
+template <typename T>
+bool RunChecks(std::vector<T>& checks)
+{
+    for (T& check : checks) {
+        if (!check()) return false;
+    }
+    return true;
+}
+
 /**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
@@ -115,9 +129,8 @@ private:
                 fOk = fAllOk;
             }
             // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
+            if (fOk)
+                fOk = RunChecks(vChecks);
             vChecks.clear();
         } while (true);
     }
@@ -12,6 +12,7 @@
 #include <memusage.h>
 #include <primitives/transaction.h>
 #include <serialize.h>
+#include <support/allocators/pool.h>
 #include <uint256.h>
 
 #include <assert.h>
@@ -128,6 +129,13 @@ struct CCoinsCacheEntry
 {
     Coin coin; // The actual cached data.
     unsigned char flags;
+    /**
+     * Set whenever the entry is looked up or written, and cleared by the
+     * eviction sweep (see CCoinsViewCache::EvictColdCoins). Only clean
+     * entries without this mark are evicted. Kept apart from flags, as it
+     * says nothing about the state of the coin relative to the parent.
+     */
+    bool recently_used;
 
     enum Flags {
         /**
@@ -150,11 +158,26 @@ struct CCoinsCacheEntry
         FRESH = (1 << 1),
     };
 
-    CCoinsCacheEntry() : flags(0) {}
-    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
+    CCoinsCacheEntry() : flags(0), recently_used(false) {}
+    explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0), recently_used(false) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * The nodes of the map are taken from a PoolResource, which has to outlive
+ * the map and is passed to its constructor. A node holds the outpoint, the
+ * entry and the pointer to the next node; the hash is not cached (see
+ * SaltedOutpointHasher).
+ */
+typedef std::unordered_map<COutPoint,
+                           CCoinsCacheEntry,
+                           SaltedOutpointHasher,
+                           std::equal_to<COutPoint>,
+                           PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                                         sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) + sizeof(void*) * 4,
+                                         alignof(void*)>>
+    CCoinsMap;
+
+typedef CCoinsMap::allocator_type::ResourceType CCoinsMapMemoryResource;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -170,6 +193,13 @@ public:
     virtual bool Valid() const = 0;
     virtual void Next() = 0;
 
+    //! Get a new cursor over the same state as this one, at its first coin,
+    //! or nullptr if that is not supported
+    virtual CCoinsViewCursor* Clone() const { return nullptr; }
+    //! Move to the first coin of the given transaction, or of the one after it.
+    //! Only supported by cursors that can be cloned.
+    virtual void Seek(const uint256& txid) { throw std::logic_error("CCoinsViewCursor seeking not supported."); }
+
     //! Get best block at the time this cursor was created
     const uint256 &GetBestBlock() const { return hashBlock; }
 private:
@@ -199,8 +229,10 @@ public:
     virtual std::vector<uint256> GetHeadBlocks() const;
 
     //! Do a bulk modification (multiple Coin changes + BestBlock change).
-    //! The passed mapCoins can be modified.
-    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    //! The passed mapCoins can be modified. If erase is false, the entries are
+    //! copied rather than moved and left in mapCoins, so the caller can keep
+    //! them cached.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true);
 
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
@@ -226,7 +258,7 @@ public:
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -241,11 +273,15 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    mutable CCoinsMapMemoryResource m_cache_coins_memory_resource{};
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /** Where the next eviction sweep resumes, or null to start at the beginning. */
+    COutPoint m_evict_hand;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
 
@@ -259,7 +295,7 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     void SetBestBlock(const uint256 &hashBlock);
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor* Cursor() const override {
         throw std::logic_error("CCoinsViewCache cursor iteration not supported.");
     }
@@ -289,6 +325,14 @@ public:
      */
     void AddCoin(const COutPoint& outpoint, Coin&& coin, bool possible_overwrite);
 
+    /**
+     * Insert a coin that was already read from the backing view by someone
+     * else, e.g. the block input prefetcher. The entry is neither DIRTY nor
+     * FRESH. Has no effect if the outpoint is already cached or the coin is
+     * spent.
+     */
+    void EmplaceCoinFromBase(const COutPoint& outpoint, Coin&& coin);
+
     /**
      * Spend a coin. Pass moveto in order to get the deleted data.
      * If no unspent output exists for the passed outpoint, this call
@@ -303,6 +347,26 @@ public:
      */
     bool Flush();
 
+    /**
+     * Push the modifications applied to this cache to its base, like Flush(),
+     * but keep the unspent coins cached as clean entries, so the cache
+     * doesn't have to be refilled from the base afterwards. Spent entries
+     * are dropped.
+     * If false is returned, the state of this cache (and its backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Evict clean entries until the memory usage is at most max_usage bytes
+     * or only modified entries are left. Uses the CLOCK algorithm: the sweep
+     * continues where the last one stopped, and an entry used since the
+     * hand last passed it gets another round. Modified entries are never
+     * evicted, so call Sync() first to make them clean.
+     *
+     * @returns the number of evicted entries
+     */
+    size_t EvictColdCoins(size_t max_usage);
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
@@ -92,6 +92,11 @@ typedef char* sockopt_arg_type;
 #define USE_POLL
 #endif
 
+// epoll is available as an alternative socket events mode, see -socketevents
+#if defined(__linux__)
+#define USE_EPOLL
+#endif
+
 bool static inline IsSelectableSocket(const SOCKET& s) {
 #if defined(USE_POLL) || defined(WIN32)
     return true;
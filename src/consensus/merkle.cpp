@@ -64,6 +64,7 @@ uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated) {
 
 uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
 {
+    HashTransactions(block.vtx);
     std::vector<uint256> leaves;
     leaves.resize(block.vtx.size());
     for (size_t s = 0; s < block.vtx.size(); s++) {
@@ -74,6 +75,7 @@ uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
 
 uint256 BlockWitnessMerkleRoot(const CBlock& block, bool* mutated)
 {
+    HashTransactions(block.vtx);
     std::vector<uint256> leaves;
     leaves.resize(block.vtx.size());
     leaves[0].SetNull(); // The witness hash of the coinbase is 0.
@@ -0,0 +1,297 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <crypto/muhash.h>
+
+#include <crypto/chacha20.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
+
+#include <assert.h>
+#include <string.h>
+
+namespace {
+
+using limb_t = Num3072::limb_t;
+using double_limb_t = Num3072::double_limb_t;
+constexpr int LIMB_SIZE = Num3072::LIMB_SIZE;
+constexpr int LIMBS = Num3072::LIMBS;
+/** 2^3072 - 1103717 is the largest 3072-bit safe prime number, and is used as the modulus. */
+constexpr limb_t MAX_PRIME_DIFF = 1103717;
+
+/** Fold carry * 2^3072 back into the limbs, as carry * MAX_PRIME_DIFF, until nothing overflows. */
+void ReduceCarry(limb_t* limbs, limb_t carry)
+{
+    while (carry) {
+        double_limb_t t = (double_limb_t)carry * MAX_PRIME_DIFF;
+        for (int i = 0; i < LIMBS && t; ++i) {
+            t += limbs[i];
+            limbs[i] = (limb_t)t;
+            t >>= LIMB_SIZE;
+        }
+        carry = (limb_t)t;
+    }
+}
+
+/** A 3072-bit number with a limb of headroom, used while computing inverses. */
+struct WideNum {
+    limb_t limbs[LIMBS + 1];
+
+    bool IsEven() const { return !(limbs[0] & 1); }
+
+    bool IsOne() const
+    {
+        if (limbs[0] != 1) return false;
+        for (int i = 1; i <= LIMBS; ++i) {
+            if (limbs[i]) return false;
+        }
+        return true;
+    }
+
+    bool operator>=(const WideNum& b) const
+    {
+        for (int i = LIMBS; i >= 0; --i) {
+            if (limbs[i] != b.limbs[i]) return limbs[i] > b.limbs[i];
+        }
+        return true;
+    }
+
+    /** The number of trailing zero bits, up to LIMB_SIZE - 1. */
+    int TrailingZeros() const
+    {
+        int bits = 0;
+        while (bits < LIMB_SIZE - 1 && !((limbs[0] >> bits) & 1)) ++bits;
+        return bits;
+    }
+
+    /** Shift right by 0 < bits < LIMB_SIZE. */
+    void ShiftRight(int bits)
+    {
+        for (int i = 0; i < LIMBS; ++i) {
+            limbs[i] = (limbs[i] >> bits) | (limbs[i + 1] << (LIMB_SIZE - bits));
+        }
+        limbs[LIMBS] >>= bits;
+    }
+
+    /** Add b * m. The result must fit. */
+    void AddMul(const WideNum& b, limb_t m)
+    {
+        double_limb_t carry = 0;
+        for (int i = 0; i <= LIMBS; ++i) {
+            carry += (double_limb_t)b.limbs[i] * m + limbs[i];
+            limbs[i] = (limb_t)carry;
+            carry >>= LIMB_SIZE;
+        }
+    }
+
+    void Add(const WideNum& b) { AddMul(b, 1); }
+
+    /** Subtract b, returning whether it borrowed. */
+    bool Sub(const WideNum& b)
+    {
+        double_limb_t borrow = 0;
+        for (int i = 0; i <= LIMBS; ++i) {
+            const double_limb_t t = (double_limb_t)limbs[i] - b.limbs[i] - borrow;
+            limbs[i] = (limb_t)t;
+            borrow = (t >> LIMB_SIZE) & 1;
+        }
+        return borrow;
+    }
+};
+
+WideNum Modulus()
+{
+    WideNum p;
+    for (int i = 0; i < LIMBS; ++i) p.limbs[i] = ~limb_t{0};
+    p.limbs[LIMBS] = 0;
+    p.limbs[0] -= MAX_PRIME_DIFF - 1;
+    return p;
+}
+
+} // namespace
+
+bool Num3072::IsZero() const
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (limbs[i]) return false;
+    }
+    return true;
+}
+
+void Num3072::FullReduce()
+{
+    // The value is below 2^3072, so at most one modulus has to be subtracted.
+    // It has to be if adding MAX_PRIME_DIFF overflows 3072 bits, and the
+    // truncated sum is then the result.
+    limb_t sum[LIMBS];
+    double_limb_t t = MAX_PRIME_DIFF;
+    for (int i = 0; i < LIMBS; ++i) {
+        t += limbs[i];
+        sum[i] = (limb_t)t;
+        t >>= LIMB_SIZE;
+    }
+    if (t) memcpy(limbs, sum, sizeof(limbs));
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t product[2 * LIMBS] = {};
+    for (int i = 0; i < LIMBS; ++i) {
+        double_limb_t carry = 0;
+        for (int j = 0; j < LIMBS; ++j) {
+            carry += (double_limb_t)limbs[i] * a.limbs[j] + product[i + j];
+            product[i + j] = (limb_t)carry;
+            carry >>= LIMB_SIZE;
+        }
+        product[i + LIMBS] = (limb_t)carry;
+    }
+
+    // product = low + high * 2^3072, which is low + high * MAX_PRIME_DIFF modulo the prime.
+    double_limb_t carry = 0;
+    for (int i = 0; i < LIMBS; ++i) {
+        carry += (double_limb_t)product[LIMBS + i] * MAX_PRIME_DIFF + product[i];
+        limbs[i] = (limb_t)carry;
+        carry >>= LIMB_SIZE;
+    }
+    ReduceCarry(limbs, (limb_t)carry);
+}
+
+Num3072 Num3072::GetInverse() const
+{
+    // Binary extended Euclidean algorithm. The inputs are public, so it does
+    // not need to run in constant time.
+    Num3072 reduced{*this};
+    reduced.FullReduce();
+    assert(!reduced.IsZero());
+
+    const WideNum p = Modulus();
+    // The inverse of p modulo 2^LIMB_SIZE, by Newton's iteration.
+    limb_t p_inv = p.limbs[0];
+    for (int i = 0; i < 6; ++i) p_inv *= 2 - p.limbs[0] * p_inv;
+
+    WideNum u, v = p, x1{}, x2{};
+    memcpy(u.limbs, reduced.limbs, sizeof(reduced.limbs));
+    u.limbs[LIMBS] = 0;
+    x1.limbs[0] = 1;
+
+    // Keep x1 * this = u and x2 * this = v (mod p), with x1 and x2 below p.
+    // Dividing x by 2^bits modulo p adds the multiple of p that makes it a
+    // multiple of 2^bits first.
+    auto divide = [&p, p_inv](WideNum& x, int bits) {
+        const limb_t mask = (limb_t{1} << bits) - 1;
+        x.AddMul(p, (0 - x.limbs[0] * p_inv) & mask);
+        x.ShiftRight(bits);
+    };
+    while (!u.IsOne() && !v.IsOne()) {
+        while (u.IsEven()) {
+            const int bits = u.TrailingZeros();
+            u.ShiftRight(bits);
+            divide(x1, bits);
+        }
+        while (v.IsEven()) {
+            const int bits = v.TrailingZeros();
+            v.ShiftRight(bits);
+            divide(x2, bits);
+        }
+        if (u >= v) {
+            u.Sub(v);
+            if (x1.Sub(x2)) x1.Add(p);
+        } else {
+            v.Sub(u);
+            if (x2.Sub(x1)) x2.Add(p);
+        }
+    }
+
+    Num3072 inv;
+    memcpy(inv.limbs, u.IsOne() ? x1.limbs : x2.limbs, sizeof(inv.limbs));
+    return inv;
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(a.GetInverse());
+}
+
+void Num3072::SetToOne()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; ++i) {
+        limbs[i] = 0;
+    }
+}
+
+Num3072::Num3072(const unsigned char (&data)[BYTE_SIZE])
+{
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            limbs[i] = ReadLE32(data + 4 * i);
+        } else if (sizeof(limb_t) == 8) {
+            limbs[i] = ReadLE64(data + 8 * i);
+        }
+    }
+}
+
+void Num3072::ToBytes(unsigned char (&out)[BYTE_SIZE])
+{
+    FullReduce();
+    for (int i = 0; i < LIMBS; ++i) {
+        if (sizeof(limb_t) == 4) {
+            WriteLE32(out + i * 4, limbs[i]);
+        } else if (sizeof(limb_t) == 8) {
+            WriteLE64(out + i * 8, limbs[i]);
+        }
+    }
+}
+
+Num3072 MuHash3072::ToNum3072(Span<const unsigned char> in)
+{
+    unsigned char tmp[Num3072::BYTE_SIZE];
+
+    uint256 hashed_in;
+    CSHA256().Write(in.data(), in.size()).Finalize(hashed_in.begin());
+    ChaCha20(hashed_in.begin(), hashed_in.size()).Keystream(tmp, Num3072::BYTE_SIZE);
+    Num3072 out{tmp};
+
+    return out;
+}
+
+MuHash3072::MuHash3072(Span<const unsigned char> in) noexcept
+{
+    m_numerator = ToNum3072(in);
+}
+
+void MuHash3072::Finalize(uint256& out) noexcept
+{
+    m_numerator.Divide(m_denominator);
+    m_denominator.SetToOne(); // Needed to keep the MuHash object valid
+
+    unsigned char data[Num3072::BYTE_SIZE];
+    m_numerator.ToBytes(data);
+
+    CSHA256().Write(data, sizeof(data)).Finalize(out.begin());
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& mul) noexcept
+{
+    m_numerator.Multiply(mul.m_numerator);
+    m_denominator.Multiply(mul.m_denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& div) noexcept
+{
+    m_numerator.Multiply(div.m_denominator);
+    m_denominator.Multiply(div.m_numerator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::Insert(Span<const unsigned char> in) noexcept {
+    m_numerator.Multiply(ToNum3072(in));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(Span<const unsigned char> in) noexcept {
+    m_denominator.Multiply(ToNum3072(in));
+    return *this;
+}
@@ -8,6 +8,8 @@
 #include <assert.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include <compat/cpuid.h>
 
 #if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
@@ -27,6 +29,7 @@ void Transform_4way(unsigned char* out, const unsigned char* in);
 namespace sha256d64_avx2
 {
 void Transform_8way(unsigned char* out, const unsigned char* in);
+void TransformBlocks_8way(uint32_t* const* s, const unsigned char* const* chunks);
 }
 
 namespace sha256d64_shani
@@ -37,6 +40,7 @@ void Transform_2way(unsigned char* out, const unsigned char* in);
 namespace sha256_shani
 {
 void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+void TransformBlocks_2way(uint32_t* const* s, const unsigned char* const* chunks);
 }
 
 // Internal implementation code.
@@ -462,6 +466,113 @@ TransformD64Type TransformD64_2way = nullptr;
 TransformD64Type TransformD64_4way = nullptr;
 TransformD64Type TransformD64_8way = nullptr;
 
+/** Process one block of each of a number of messages (the width of the implementation). */
+typedef void (*TransformBlocksType)(uint32_t* const*, const unsigned char* const*);
+TransformBlocksType TransformBlocks_2way = nullptr;
+TransformBlocksType TransformBlocks_8way = nullptr;
+
+/** One message being hashed in a lane of a multi-way transform. */
+struct BatchLane {
+    uint32_t state[8];
+    const unsigned char* data; //!< the message's remaining full blocks
+    size_t blocks;
+    unsigned char tail[128]; //!< the last bytes of the message, padded
+    size_t tail_blocks;
+    size_t tail_done;
+    unsigned char* out;
+
+    void Start(const unsigned char* in, size_t len, unsigned char* out_in)
+    {
+        sha256::Initialize(state);
+        data = in;
+        blocks = len / 64;
+        const size_t rest = len % 64;
+        tail_blocks = rest < 56 ? 1 : 2;
+        tail_done = 0;
+        if (rest) memcpy(tail, in + 64 * blocks, rest);
+        tail[rest] = 0x80;
+        memset(tail + rest + 1, 0, 64 * tail_blocks - rest - 9);
+        WriteBE64(tail + 64 * tail_blocks - 8, uint64_t(len) << 3);
+        out = out_in;
+    }
+
+    bool Done() const { return blocks == 0 && tail_done == tail_blocks; }
+
+    /** Return the next block to process. */
+    const unsigned char* Next()
+    {
+        if (blocks) {
+            --blocks;
+            data += 64;
+            return data - 64;
+        }
+        return tail + 64 * tail_done++;
+    }
+
+    void Finish() const
+    {
+        for (int i = 0; i < 8; ++i) WriteBE32(out + 4 * i, state[i]);
+    }
+};
+
+/** Compute the double-SHA256 of count messages, running N of them at a time through transform. */
+template<size_t N>
+void SHA256DLanes(TransformBlocksType transform, unsigned char* output, const unsigned char* const* inputs, const size_t* lengths, size_t count)
+{
+    BatchLane lanes[N];
+    uint32_t* states[N];
+    const unsigned char* chunks[N];
+    bool busy[N] = {};
+    size_t next = 0;
+
+    // First hash: whenever a lane finishes its message it takes the next one,
+    // until there are too few left to keep all lanes busy.
+    while (true) {
+        for (size_t i = 0; i < N; ++i) {
+            if (!busy[i] && next < count) {
+                lanes[i].Start(inputs[next], lengths[next], output + 32 * next);
+                busy[i] = true;
+                ++next;
+            }
+        }
+        if (std::find(busy, busy + N, false) != busy + N) break;
+        for (size_t i = 0; i < N; ++i) {
+            states[i] = lanes[i].state;
+            chunks[i] = lanes[i].Next();
+        }
+        transform(states, chunks);
+        for (size_t i = 0; i < N; ++i) {
+            if (lanes[i].Done()) {
+                lanes[i].Finish();
+                busy[i] = false;
+            }
+        }
+    }
+    for (size_t i = 0; i < N; ++i) {
+        if (!busy[i]) continue;
+        while (!lanes[i].Done()) Transform(lanes[i].state, lanes[i].Next(), 1);
+        lanes[i].Finish();
+    }
+
+    // Second hash: every message is a single block made of the first hash.
+    for (size_t done = 0; done < count;) {
+        const size_t width = count - done >= N ? N : 1;
+        for (size_t i = 0; i < width; ++i) {
+            unsigned char* out = output + 32 * (done + i);
+            lanes[i].Start(out, 32, out);
+            states[i] = lanes[i].state;
+            chunks[i] = lanes[i].Next();
+        }
+        if (width == N) {
+            transform(states, chunks);
+        } else {
+            Transform(states[0], chunks[0], 1);
+        }
+        for (size_t i = 0; i < width; ++i) lanes[i].Finish();
+        done += width;
+    }
+}
+
 bool SelfTest() {
     // Input state (equal to the initial SHA256 state)
     static const uint32_t init[8] = {
@@ -544,6 +655,19 @@ bool SelfTest() {
         if (!std::equal(out, out + 256, result_d64)) return false;
     }
 
+    // Test SHA256DBatch on messages of all padding cases, more than the lanes.
+    static const size_t lengths[19] = {0, 1, 31, 32, 55, 56, 57, 63, 64, 65, 119, 120, 128, 200, 256, 300, 449, 500, 640};
+    const unsigned char* inputs[19];
+    unsigned char out_batch[19 * 32];
+    for (size_t i = 0; i < 19; ++i) inputs[i] = data + 1;
+    SHA256DBatch(out_batch, inputs, lengths, 19);
+    for (size_t i = 0; i < 19; ++i) {
+        unsigned char out[32];
+        CSHA256().Write(data + 1, lengths[i]).Finalize(out);
+        CSHA256().Write(out, 32).Finalize(out);
+        if (!std::equal(out, out + 32, out_batch + 32 * i)) return false;
+    }
+
     return true;
 }
 
@@ -597,6 +721,7 @@ std::string SHA256AutoDetect()
         Transform = sha256_shani::Transform;
         TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
         TransformD64_2way = sha256d64_shani::Transform_2way;
+        TransformBlocks_2way = sha256_shani::TransformBlocks_2way;
         ret = "shani(1way,2way)";
         have_sse4 = false; // Disable SSE4/AVX2;
         have_avx2 = false;
@@ -618,6 +743,7 @@ std::string SHA256AutoDetect()
 #if defined(ENABLE_AVX2) && !defined(BUILD_BITCOIN_INTERNAL)
     if (have_avx2 && have_avx && enabled_avx) {
         TransformD64_8way = sha256d64_avx2::Transform_8way;
+        TransformBlocks_8way = sha256d64_avx2::TransformBlocks_8way;
         ret += ",avx2(8way)";
     }
 #endif
@@ -717,3 +843,18 @@ void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
         --blocks;
     }
 }
+
+void SHA256DBatch(unsigned char* output, const unsigned char* const* inputs, const size_t* lengths, size_t count)
+{
+    if (TransformBlocks_8way && count >= 8) {
+        SHA256DLanes<8>(TransformBlocks_8way, output, inputs, lengths, count);
+    } else if (TransformBlocks_2way && count >= 2) {
+        SHA256DLanes<2>(TransformBlocks_2way, output, inputs, lengths, count);
+    } else {
+        for (size_t i = 0; i < count; ++i) {
+            unsigned char* out = output + 32 * i;
+            CSHA256().Write(inputs[i], lengths[i]).Finalize(out);
+            CSHA256().Write(out, 32).Finalize(out);
+        }
+    }
+}
@@ -477,6 +477,20 @@ public:
             }
         return false;
     }
+
+    /** for_each_live calls fn on every element that has not been marked for
+     * garbage collection, i.e. every element that was inserted and neither
+     * erased nor aged out since. Not threadsafe with concurrent insert.
+     *
+     * @param fn callable taking a const Element&
+     */
+    template <typename Callable>
+    void for_each_live(Callable fn) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                fn(table[i]);
+    }
 };
 } // namespace CuckooCache
 
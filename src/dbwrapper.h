@@ -297,6 +297,23 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    /** A consistent read-only view of the database, as of when it was taken. */
+    using Snapshot = std::shared_ptr<const leveldb::Snapshot>;
+
+    Snapshot GetSnapshot()
+    {
+        leveldb::DB* db = pdb;
+        return Snapshot(pdb->GetSnapshot(), [db](const leveldb::Snapshot* snapshot) { db->ReleaseSnapshot(snapshot); });
+    }
+
+    /** Iterate over the database as of the snapshot, which must outlive the iterator. */
+    CDBIterator *NewIterator(const Snapshot& snapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot.get();
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
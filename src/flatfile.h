@@ -6,10 +6,12 @@
 #ifndef BITCOIN_FLATFILE_H
 #define BITCOIN_FLATFILE_H
 
+#include <memory>
 #include <string>
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
 
 struct FlatFilePos
 {
@@ -39,6 +41,23 @@ struct FlatFilePos
     std::string ToString() const;
 };
 
+/** A read-only memory mapping of a flat file, which is unmapped again on destruction. */
+class MappedFlatFile
+{
+private:
+    const unsigned char* const m_data;
+    const size_t m_size;
+
+public:
+    MappedFlatFile(const unsigned char* data, size_t size) : m_data(data), m_size(size) {}
+    ~MappedFlatFile();
+
+    MappedFlatFile(const MappedFlatFile&) = delete;
+    MappedFlatFile& operator=(const MappedFlatFile&) = delete;
+
+    Span<const unsigned char> Data() const { return Span<const unsigned char>(m_data, m_size); }
+};
+
 /**
  * FlatFileSeq represents a sequence of numbered files storing raw data. This class facilitates
  * access to and efficient management of these files.
@@ -66,6 +85,14 @@ public:
     /** Open a handle to the file at the given position. */
     FILE* Open(const FlatFilePos& pos, bool read_only = false);
 
+    /**
+     * Map the whole file at the given position read-only into memory. Data appended to the file
+     * afterwards is not covered by the mapping.
+     *
+     * @return The mapping, or nullptr on failure or on platforms without support for it.
+     */
+    std::shared_ptr<const MappedFlatFile> Map(const FlatFilePos& pos) const;
+
     /**
      * Allocate additional space in a file after the given starting position. The amount allocated
      * will be the minimum multiple of the sequence chunk size greater than add_size.
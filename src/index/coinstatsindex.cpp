@@ -0,0 +1,345 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+
+#include <chainparams.h>
+#include <coins.h>
+#include <node/coinstats.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores the UTXO set statistics after each block. Those
+ * of blocks on the active chain are indexed by height, and those of blocks that
+ * have been reorganized out of it by block hash, like in the block filter index.
+ *
+ * The running MuHash of the UTXO set is stored under the DB_MUHASH key, with
+ * the hash of the block it is at, when the index state is committed.
+ *
+ * Keys for the height index have the type [DB_BLOCK_HEIGHT, uint32 (BE)].
+ * Keys for the hash index have the type [DB_BLOCK_HASH, uint256].
+ */
+constexpr char DB_BLOCK_HASH = 's';
+constexpr char DB_BLOCK_HEIGHT = 't';
+constexpr char DB_MUHASH = 'M';
+
+namespace {
+
+struct DBVal {
+    uint256 muhash;
+    uint64_t transaction_output_count;
+    uint64_t bogo_size;
+    CAmount total_amount;
+
+    SERIALIZE_METHODS(DBVal, obj) { READWRITE(obj.muhash, obj.transaction_output_count, obj.bogo_size, obj.total_amount); }
+};
+
+struct DBHeightKey {
+    int height;
+
+    DBHeightKey() : height(0) {}
+    explicit DBHeightKey(int height_in) : height(height_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_BLOCK_HEIGHT);
+        ser_writedata32be(s, height);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_BLOCK_HEIGHT) {
+            throw std::ios_base::failure("Invalid format for coin stats index DB height key");
+        }
+        height = ser_readdata32be(s);
+    }
+};
+
+struct DBHashKey {
+    uint256 hash;
+
+    explicit DBHashKey(const uint256& hash_in) : hash(hash_in) {}
+
+    SERIALIZE_METHODS(DBHashKey, obj) {
+        char prefix = DB_BLOCK_HASH;
+        READWRITE(prefix);
+        if (prefix != DB_BLOCK_HASH) {
+            throw std::ios_base::failure("Invalid format for coin stats index DB hash key");
+        }
+
+        READWRITE(obj.hash);
+    }
+};
+
+}; // namespace
+
+std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+{
+    fs::path path = GetDataDir() / "indexes" / "coinstats";
+    fs::create_directories(path);
+
+    m_name = "coinstatsindex";
+    m_db = MakeUnique<BaseIndex::DB>(path / "db", n_cache_size, f_memory, f_wipe);
+}
+
+static bool LookUpOne(const CDBWrapper& db, const CBlockIndex* block_index, DBVal& result)
+{
+    // First check if the result is stored under the height index and the value there matches the
+    // block hash. This should be the case if the block is on the active chain.
+    std::pair<uint256, DBVal> read_out;
+    if (!db.Read(DBHeightKey(block_index->nHeight), read_out)) {
+        return false;
+    }
+    if (read_out.first == block_index->GetBlockHash()) {
+        result = std::move(read_out.second);
+        return true;
+    }
+
+    // If value at the height index corresponds to an different block, the result will be stored in
+    // the hash index.
+    return db.Read(DBHashKey(block_index->GetBlockHash()), result);
+}
+
+bool CoinStatsIndex::Init()
+{
+    std::pair<uint256, MuHash3072> state;
+    if (!m_db->Read(DB_MUHASH, state)) {
+        // Check that the cause of the read failure is that the key does not exist. Any other errors
+        // indicate database corruption or a disk failure, and starting the index would cause
+        // further corruption.
+        if (m_db->Exists(DB_MUHASH)) {
+            return error("%s: Cannot read current %s state; index may be corrupted",
+                         __func__, GetName());
+        }
+    }
+
+    if (!BaseIndex::Init()) return false;
+
+    const CBlockIndex* pindex = CurrentIndex();
+    if (!pindex) return true;
+    const CBlockIndex* stats_block = WITH_LOCK(cs_main, return LookupBlockIndex(state.first));
+    if (!stats_block) {
+        return error("%s: Cannot find the block of the %s state; index may be corrupted",
+                     __func__, GetName());
+    }
+
+    LOCK(m_cs_stats);
+    m_muhash = state.second;
+    m_stats_block = stats_block;
+    if (m_stats_block != pindex) {
+        // The state was committed at another block than the best block, which is
+        // possible after a reorganization while shut down, or a crash.
+        LogPrintf("%s: Moving the %s state from block %s to %s\n", __func__, GetName(),
+                  m_stats_block->GetBlockHash().ToString(), pindex->GetBlockHash().ToString());
+        if (!MoveStatsTo(pindex)) return false;
+    }
+
+    DBVal entry;
+    if (!LookUpOne(*m_db, pindex, entry)) {
+        return error("%s: Cannot read the %s stats of block %s; index may be corrupted",
+                     __func__, GetName(), pindex->GetBlockHash().ToString());
+    }
+    uint256 muhash;
+    m_muhash.Finalize(muhash);
+    if (muhash != entry.muhash) {
+        return error("%s: Current %s state does not match block %s; index may be corrupted",
+                     __func__, GetName(), pindex->GetBlockHash().ToString());
+    }
+    m_transaction_output_count = entry.transaction_output_count;
+    m_bogo_size = entry.bogo_size;
+    m_total_amount = entry.total_amount;
+    return true;
+}
+
+bool CoinStatsIndex::CommitInternal(CDBBatch& batch)
+{
+    {
+        LOCK(m_cs_stats);
+        batch.Write(DB_MUHASH, std::make_pair(m_stats_block ? m_stats_block->GetBlockHash() : uint256(), m_muhash));
+    }
+    return BaseIndex::CommitInternal(batch);
+}
+
+bool CoinStatsIndex::ApplyBlock(const CBlock& block, const CBlockUndo& block_undo, int height, bool connect)
+{
+    if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: undo data of block %s does not match it", __func__, block.GetHash().ToString());
+    }
+
+    auto update = [&](const COutPoint& outpoint, const Coin& coin, bool add) {
+        const CDataStream ser = TxOutSer(outpoint, coin);
+        if (add) {
+            m_muhash.Insert(MakeUCharSpan(ser));
+            ++m_transaction_output_count;
+            m_bogo_size += GetBogoSize(coin.out.scriptPubKey);
+            m_total_amount += coin.out.nValue;
+        } else {
+            m_muhash.Remove(MakeUCharSpan(ser));
+            --m_transaction_output_count;
+            m_bogo_size -= GetBogoSize(coin.out.scriptPubKey);
+            m_total_amount -= coin.out.nValue;
+        }
+    };
+
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        for (uint32_t j = 0; j < tx.vout.size(); ++j) {
+            const CTxOut& out = tx.vout[j];
+            // Unspendable outputs are not added to the UTXO set.
+            if (out.scriptPubKey.IsUnspendable()) continue;
+            update(COutPoint(tx.GetHash(), j), Coin(out, height, tx.IsCoinBase()), connect);
+        }
+
+        // The coinbase does not spend anything, and has no undo data.
+        if (i == 0) continue;
+        const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+        if (tx_undo.vprevout.size() != tx.vin.size()) {
+            return error("%s: undo data of transaction %s does not match it", __func__, tx.GetHash().ToString());
+        }
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            update(tx.vin[j].prevout, tx_undo.vprevout[j], !connect);
+        }
+    }
+    return true;
+}
+
+bool CoinStatsIndex::MoveStatsTo(const CBlockIndex* target)
+{
+    const Consensus::Params& consensus_params = Params().GetConsensus();
+    auto read_block = [&](const CBlockIndex* pindex, CBlock& block, CBlockUndo& block_undo) {
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: Failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return error("%s: Failed to read undo data of block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        }
+        return true;
+    };
+
+    const CBlockIndex* fork = LastCommonAncestor(m_stats_block, target);
+    for (const CBlockIndex* pindex = m_stats_block; pindex != fork; pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!read_block(pindex, block, block_undo) || !ApplyBlock(block, block_undo, pindex->nHeight, /* connect */ false)) {
+            return false;
+        }
+    }
+    std::vector<const CBlockIndex*> to_connect;
+    for (const CBlockIndex* pindex = target; pindex != fork; pindex = pindex->pprev) {
+        to_connect.push_back(pindex);
+    }
+    for (auto it = to_connect.rbegin(); it != to_connect.rend(); ++it) {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!read_block(*it, block, block_undo) || !ApplyBlock(block, block_undo, (*it)->nHeight, /* connect */ true)) {
+            return false;
+        }
+    }
+    m_stats_block = target;
+    return true;
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    LOCK(m_cs_stats);
+
+    // The outputs of the genesis block are not added to the UTXO set.
+    if (pindex->nHeight > 0) {
+        if (m_stats_block != pindex->pprev) {
+            return error("%s: block %s does not connect to the %s state",
+                         __func__, pindex->GetBlockHash().ToString(), GetName());
+        }
+
+        CBlockUndo block_undo;
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return false;
+        }
+        if (!ApplyBlock(block, block_undo, pindex->nHeight, /* connect */ true)) {
+            return false;
+        }
+    }
+    m_stats_block = pindex;
+
+    std::pair<uint256, DBVal> value;
+    value.first = pindex->GetBlockHash();
+    m_muhash.Finalize(value.second.muhash);
+    value.second.transaction_output_count = m_transaction_output_count;
+    value.second.bogo_size = m_bogo_size;
+    value.second.total_amount = m_total_amount;
+    return m_db->Write(DBHeightKey(pindex->nHeight), value);
+}
+
+static bool CopyHeightIndexToHashIndex(CDBIterator& db_it, CDBBatch& batch,
+                                       const std::string& index_name,
+                                       int start_height, int stop_height)
+{
+    DBHeightKey key(start_height);
+    db_it.Seek(key);
+
+    for (int height = start_height; height <= stop_height; ++height) {
+        if (!db_it.GetKey(key) || key.height != height) {
+            return error("%s: unexpected key in %s: expected (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        std::pair<uint256, DBVal> value;
+        if (!db_it.GetValue(value)) {
+            return error("%s: unable to read value in %s at key (%c, %d)",
+                         __func__, index_name, DB_BLOCK_HEIGHT, height);
+        }
+
+        batch.Write(DBHashKey(value.first), std::move(value.second));
+
+        db_it.Next();
+    }
+    return true;
+}
+
+bool CoinStatsIndex::Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip)
+{
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    CDBBatch batch(*m_db);
+    std::unique_ptr<CDBIterator> db_it(m_db->NewIterator());
+
+    // During a reorg, we need to copy the stats of the blocks that are getting disconnected from
+    // the height index to the hash index so we can still find them when the height index entries
+    // are overwritten.
+    if (!CopyHeightIndexToHashIndex(*db_it, batch, m_name, new_tip->nHeight, current_tip->nHeight)) {
+        return false;
+    }
+    if (!m_db->WriteBatch(batch)) return false;
+
+    {
+        LOCK(m_cs_stats);
+        // Take the outputs of the disconnected blocks out of the UTXO set, and put back the
+        // ones they spent.
+        if (!MoveStatsTo(new_tip)) return false;
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const
+{
+    DBVal entry;
+    if (!LookUpOne(*m_db, block_index, entry)) {
+        return false;
+    }
+
+    coins_stats.nHeight = block_index->nHeight;
+    coins_stats.hashBlock = block_index->GetBlockHash();
+    coins_stats.hashSerialized = entry.muhash;
+    coins_stats.nTransactionOutputs = entry.transaction_output_count;
+    coins_stats.nBogoSize = entry.bogo_size;
+    coins_stats.nTotalAmount = entry.total_amount;
+    coins_stats.from_index = true;
+    return true;
+}
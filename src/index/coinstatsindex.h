@@ -0,0 +1,72 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_COINSTATSINDEX_H
+#define BITCOIN_INDEX_COINSTATSINDEX_H
+
+#include <chain.h>
+#include <crypto/muhash.h>
+#include <index/base.h>
+#include <sync.h>
+
+class CBlockUndo;
+struct CCoinsStats;
+
+static constexpr bool DEFAULT_COINSTATSINDEX{false};
+
+/**
+ * CoinStatsIndex keeps the statistics of the UTXO set after each block: its
+ * MuHash, the number of outputs, their total amount and bogosize. They are
+ * updated incrementally from the outputs each block creates and spends, so
+ * gettxoutsetinfo can answer for any height without scanning the coins.
+ */
+class CoinStatsIndex final : public BaseIndex
+{
+private:
+    std::string m_name;
+    std::unique_ptr<BaseIndex::DB> m_db;
+
+    /** Serializes the updates of the running state with committing it. */
+    mutable Mutex m_cs_stats;
+    /** The UTXO set at m_stats_block, which may be ahead of the committed best block. */
+    MuHash3072 m_muhash GUARDED_BY(m_cs_stats);
+    const CBlockIndex* m_stats_block GUARDED_BY(m_cs_stats){nullptr};
+    uint64_t m_transaction_output_count GUARDED_BY(m_cs_stats){0};
+    uint64_t m_bogo_size GUARDED_BY(m_cs_stats){0};
+    CAmount m_total_amount GUARDED_BY(m_cs_stats){0};
+
+    /** Add the outputs a block creates and remove the ones it spends, or the reverse. */
+    bool ApplyBlock(const CBlock& block, const CBlockUndo& block_undo, int height, bool connect) EXCLUSIVE_LOCKS_REQUIRED(m_cs_stats);
+
+    /** Move the running state from m_stats_block to another block, reading the blocks in between from disk. */
+    bool MoveStatsTo(const CBlockIndex* pindex) EXCLUSIVE_LOCKS_REQUIRED(m_cs_stats);
+
+protected:
+    bool Init() override;
+
+    bool CommitInternal(CDBBatch& batch) override;
+
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool Rewind(const CBlockIndex* current_tip, const CBlockIndex* new_tip) override;
+
+    BaseIndex::DB& GetDB() const override { return *m_db; }
+
+    const char* GetName() const override { return m_name.c_str(); }
+
+public:
+    /** Constructs the index, which becomes available to be queried. */
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /**
+     * Look up the UTXO set statistics after a block. Fills in everything but
+     * the number of transactions, the coin count and the disk size.
+     */
+    bool LookUpStats(const CBlockIndex* block_index, CCoinsStats& coins_stats) const;
+};
+
+/// The global UTXO set statistics index. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coin_stats_index;
+
+#endif // BITCOIN_INDEX_COINSTATSINDEX_H
@@ -7,6 +7,7 @@
 
 #include <indirectmap.h>
 #include <prevector.h>
+#include <support/allocators/pool.h>
 
 #include <stdlib.h>
 
@@ -167,6 +168,19 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename W, size_t MAX_BLOCK_SIZE_BYTES, size_t ALIGN_BYTES>
+static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z, W, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> >& m)
+{
+    // The nodes live in the chunks of the pool, which are only given back when
+    // the pool is destroyed, so count the chunks rather than the nodes. Each
+    // chunk is also referenced from a std::list node of three pointers.
+    // Erased nodes wait in the pool's free lists and are reused before the
+    // pool grows again, so they don't count.
+    const auto* pool_resource = m.get_allocator().resource();
+    const size_t usage_chunks = (MallocUsage(pool_resource->ChunkSizeBytes()) + MallocUsage(sizeof(void*) * 3)) * pool_resource->NumAllocatedChunks();
+    return usage_chunks - pool_resource->FreeListBytes() + MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
@@ -94,6 +94,20 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+    m_block_full = false;
+}
+
+bool BlockAssembler::CanUpdateBlock(const CBlockIndex* pindexPrev) const
+{
+    if (!m_last_template || m_last_prev != pindexPrev || m_block_full) return false;
+    // Every addition to and removal from the mempool, as well as a
+    // prioritisation, bumps its update counter. If the counter went up by
+    // exactly as much as the mempool grew, there were only additions, the
+    // entries in inBlock are all still there and the new entries are the ones
+    // appended to vTxHashes since.
+    const size_t mempool_size = m_mempool.mapTx.size();
+    return mempool_size >= m_last_mempool_size &&
+           m_mempool.GetTransactionsUpdated() - m_last_mempool_updated == mempool_size - m_last_mempool_size;
 }
 
 Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
@@ -103,23 +117,38 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 {
     int64_t nTimeStart = GetTimeMicros();
 
-    resetBlock();
+    LOCK2(cs_main, m_mempool.cs);
+    CBlockIndex* pindexPrev = ::ChainActive().Tip();
+    assert(pindexPrev != nullptr);
+    nHeight = pindexPrev->nHeight + 1;
 
-    pblocktemplate.reset(new CBlockTemplate());
+    // Transactions added to the mempool since the previous template, if that
+    // template can be extended with them
+    std::vector<CTxMemPool::txiter> new_entries;
+    const bool fUpdate = CanUpdateBlock(pindexPrev);
+    if (fUpdate) {
+        // Take the previous template, so that it is not reused if this fails
+        pblocktemplate = std::move(m_last_template);
+        new_entries.reserve(m_mempool.vTxHashes.size() - m_last_mempool_size);
+        for (size_t i = m_last_mempool_size; i < m_mempool.vTxHashes.size(); ++i) {
+            new_entries.push_back(m_mempool.vTxHashes[i].second);
+        }
+    } else {
+        resetBlock();
+        m_last_template.reset();
+        pblocktemplate.reset(new CBlockTemplate());
+    }
 
     if(!pblocktemplate.get())
         return nullptr;
     CBlock* const pblock = &pblocktemplate->block; // pointer for convenience
 
-    // Add dummy coinbase tx as first transaction
-    pblock->vtx.emplace_back();
-    pblocktemplate->vTxFees.push_back(-1); // updated at end
-    pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
-
-    LOCK2(cs_main, m_mempool.cs);
-    CBlockIndex* pindexPrev = ::ChainActive().Tip();
-    assert(pindexPrev != nullptr);
-    nHeight = pindexPrev->nHeight + 1;
+    if (!fUpdate) {
+        // Add dummy coinbase tx as first transaction
+        pblock->vtx.emplace_back();
+        pblocktemplate->vTxFees.push_back(-1); // updated at end
+        pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
+    }
 
     pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
     // -regtest only: allow overriding block.nVersion with
@@ -147,7 +176,7 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    addPackageTxs(nPackagesSelected, nDescendantsUpdated, fUpdate ? &new_entries : nullptr);
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -181,7 +210,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants%s), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, fUpdate ? strprintf(", %u new txs", new_entries.size()) : "", 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+
+    m_last_template.reset(new CBlockTemplate(*pblocktemplate));
+    m_last_prev = pindexPrev;
+    m_last_mempool_updated = m_mempool.GetTransactionsUpdated();
+    m_last_mempool_size = m_mempool.mapTx.size();
 
     return std::move(pblocktemplate);
 }
@@ -306,7 +340,7 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::ve
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
+void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated, const std::vector<CTxMemPool::txiter>* candidates)
 {
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
@@ -314,13 +348,36 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     // Keep track of entries that failed inclusion, to avoid duplicate work
     CTxMemPool::setEntries failedTx;
 
-    // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
     CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = m_mempool.mapTx.get<ancestor_score>().begin();
     CTxMemPool::txiter iter;
 
+    if (candidates) {
+        // Only consider the candidates: put them all in mapModifiedTx, with
+        // their ancestor state modified for ancestors already in the block, and
+        // skip the walk over mapTx. Descendants of packages added from here on
+        // are still picked up through mapModifiedTx as usual.
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        for (CTxMemPool::txiter it : *candidates) {
+            if (inBlock.count(it)) continue;
+            CTxMemPoolModifiedEntry modEntry(it);
+            CTxMemPool::setEntries ancestors;
+            m_mempool.CalculateMemPoolAncestors(*it, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            for (CTxMemPool::txiter anc : ancestors) {
+                if (!inBlock.count(anc)) continue;
+                modEntry.nSizeWithAncestors -= anc->GetTxSize();
+                modEntry.nModFeesWithAncestors -= anc->GetModifiedFee();
+                modEntry.nSigOpCostWithAncestors -= anc->GetSigOpCost();
+            }
+            mapModifiedTx.insert(modEntry);
+        }
+        mi = m_mempool.mapTx.get<ancestor_score>().end();
+    } else {
+        // Start by adding all descendants of previously added txs to mapModifiedTx
+        // and modifying them for their already included ancestors
+        UpdatePackagesForAdded(inBlock, mapModifiedTx);
+    }
+
     // Limit the number of attempts to add transactions to the block when it is
     // close to full; this is just a simple heuristic to finish quickly if the
     // mempool has a lot of entries.
@@ -380,6 +437,7 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
         }
 
         if (!TestPackage(packageSize, packageSigOpsCost)) {
+            m_block_full = true;
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
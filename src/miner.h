@@ -122,7 +122,17 @@ struct update_for_parent_inclusion
     CTxMemPool::txiter iter;
 };
 
-/** Generate a new block, without valid proof-of-work */
+/**
+ * Generate a new block, without valid proof-of-work.
+ *
+ * When CreateNewBlock is called again on the same BlockAssembler, the
+ * previous transaction selection is extended with the packages of the
+ * transactions added to the mempool since, instead of walking the whole
+ * mempool again. This is only done when the tip is unchanged, no transaction
+ * was removed or prioritised in between, and the previous block was not
+ * limited by its weight or sigops; otherwise a new block is assembled from
+ * scratch.
+ */
 class BlockAssembler
 {
 private:
@@ -140,6 +150,15 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // Whether a package was left out because it did not fit in the block
+    bool m_block_full{false};
+
+    // The previous block template of this assembler and the mempool state it
+    // was built from, to update that template incrementally
+    std::unique_ptr<CBlockTemplate> m_last_template;
+    const CBlockIndex* m_last_prev{nullptr};
+    unsigned int m_last_mempool_updated{0};
+    size_t m_last_mempool_size{0};
 
     // Chain context for the block
     int nHeight;
@@ -157,7 +176,8 @@ public:
     explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params);
     explicit BlockAssembler(const CTxMemPool& mempool, const CChainParams& params, const Options& options);
 
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
+    /** Construct a new block template with coinbase to scriptPubKeyIn, updating
+     *  the previous template of this assembler if possible */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
 
     static Optional<int64_t> m_last_block_num_txs;
@@ -167,14 +187,19 @@ private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Whether the previous template can be extended for the current tip and
+      * mempool, because transactions were only added to the mempool since */
+    bool CanUpdateBlock(const CBlockIndex* pindexPrev) const EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
-      * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
+      * statistics from the package selection (for logging statistics).
+      * If candidates is given, only those transactions (and the packages
+      * they pull in) are considered instead of the whole mempool. */
+    void addPackageTxs(int& nPackagesSelected, int& nDescendantsUpdated, const std::vector<CTxMemPool::txiter>* candidates = nullptr) EXCLUSIVE_LOCKS_REQUIRED(m_mempool.cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
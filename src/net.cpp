@@ -20,6 +20,7 @@
 #include <random.h>
 #include <scheduler.h>
 #include <util/strencodings.h>
+#include <util/string.h>
 #include <util/translation.h>
 
 #ifdef WIN32
@@ -36,6 +37,10 @@
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/upnpcommands.h>
@@ -105,6 +110,21 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+// Maximum number of events collected by a single epoll_wait() call
+static const int MAX_EPOLL_EVENTS = 1024;
+
+// Socket events modes supported on this platform
+static const std::map<SocketEventsMode, std::string> g_socket_events_modes = {
+#ifdef USE_POLL
+    {SocketEventsMode::POLL, "poll"},
+#else
+    {SocketEventsMode::SELECT, "select"},
+#endif
+#ifdef USE_EPOLL
+    {SocketEventsMode::EPOLL, "epoll"},
+#endif
+};
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -121,6 +141,36 @@ std::map<CNetAddr, LocalServiceInfo> mapLocalHost GUARDED_BY(cs_mapLocalHost);
 static bool vfLimited[NET_MAX] GUARDED_BY(cs_mapLocalHost) = {};
 std::string strSubVersion;
 
+const std::string& SocketEventsModeName(SocketEventsMode mode)
+{
+    static std::string unknown_retval = "";
+    auto it = g_socket_events_modes.find(mode);
+    return it != g_socket_events_modes.end() ? it->second : unknown_retval;
+}
+
+bool SocketEventsModeByName(const std::string& name, SocketEventsMode& mode)
+{
+    for (const auto& entry : g_socket_events_modes) {
+        if (entry.second == name) {
+            mode = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+const std::string& ListSocketEventsModes()
+{
+    static const std::string mode_list = [] {
+        std::vector<std::string> names;
+        for (const auto& entry : g_socket_events_modes) {
+            names.push_back(entry.second);
+        }
+        return Join(names, ", ");
+    }();
+    return mode_list;
+}
+
 void CConnman::AddAddrFetch(const std::string& strDest)
 {
     LOCK(m_addr_fetches_mutex);
@@ -794,10 +844,10 @@ Optional<CNetMessage> V1TransportDeserializer::GetMessage(const std::chrono::mic
 
 void V1TransportSerializer::prepareForTransport(CSerializedNetMsg& msg, std::vector<unsigned char>& header) {
     // create dbl-sha256 checksum
-    uint256 hash = Hash(msg.data);
+    uint256 hash = Hash(msg.Payload());
 
     // create header
-    CMessageHeader hdr(Params().MessageStart(), msg.m_type.c_str(), msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg.m_type.c_str(), msg.Payload().size());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     // serialize header
@@ -1151,6 +1201,7 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+    RegisterSocketEvents(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1189,6 +1240,7 @@ void CConnman::DisconnectNodes()
 
                 // close socket and cleanup
                 pnode->CloseSocketDisconnect();
+                m_recv_pending.erase(pnode);
 
                 // hold in disconnected pool until all refs are released
                 pnode->Release();
@@ -1266,6 +1318,40 @@ void CConnman::InactivityCheck(CNode *pnode)
     }
 }
 
+void CConnman::InitSocketEvents(SocketEventsMode mode)
+{
+    m_socket_events_mode = mode;
+#ifdef USE_EPOLL
+    if (m_socket_events_mode == SocketEventsMode::EPOLL && m_epoll_fd == -1) {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd == -1) {
+            LogPrintf("Failed to create epoll instance, falling back to %s: %s\n", SocketEventsModeName(DEFAULT_SOCKET_EVENTS_MODE), NetworkErrorString(WSAGetLastError()));
+            m_socket_events_mode = DEFAULT_SOCKET_EVENTS_MODE;
+        }
+    }
+#endif
+}
+
+void CConnman::RegisterSocketEvents(CNode* pnode)
+{
+#ifdef USE_EPOLL
+    if (m_socket_events_mode != SocketEventsMode::EPOLL) return;
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) return;
+
+    // Edge-triggered: readiness is reported once per change, and it is up to
+    // SocketHandlerEpoll() to remember peers that were not fully read.
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("Failed to add socket of peer=%d to epoll: %s\n", pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
+#endif
+}
+
 bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set)
 {
     for (const ListenSocket& hListenSocket : vhListenSocket) {
@@ -1430,8 +1516,72 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+bool CConnman::SocketRecvData(CNode* pnode)
+{
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return false;
+        nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    }
+    if (nBytes > 0)
+    {
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
+            pnode->CloseSocketDisconnect();
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            size_t nSizeAdded = 0;
+            auto it(pnode->vRecvMsg.begin());
+            for (; it != pnode->vRecvMsg.end(); ++it) {
+                // vRecvMsg contains only completed CNetMessage
+                // the single possible partially deserialized message are held by TransportDeserializer
+                nSizeAdded += it->m_raw_message_size;
+            }
+            {
+                LOCK(pnode->cs_vProcessMsg);
+                pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
+                pnode->nProcessQueueSize += nSizeAdded;
+                pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+            }
+            WakeMessageHandler();
+        }
+        // A short read means the socket has been drained
+        return nBytes == sizeof(pchBuf);
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect) {
+            LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
+        }
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect) {
+                LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
+            }
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return false;
+}
+
 void CConnman::SocketHandler()
 {
+    if (m_socket_events_mode == SocketEventsMode::EPOLL) {
+        SocketHandlerEpoll();
+        return;
+    }
+
     std::set<SOCKET> recv_set, send_set, error_set;
     SocketEvents(recv_set, send_set, error_set);
 
@@ -1479,58 +1629,7 @@ void CConnman::SocketHandler()
         }
         if (recvSet || errorSet)
         {
-            // typical socket buffer is 8K-64K
-            char pchBuf[0x10000];
-            int nBytes = 0;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-            }
-            if (nBytes > 0)
-            {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                    pnode->CloseSocketDisconnect();
-                RecordBytesRecv(nBytes);
-                if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        // vRecvMsg contains only completed CNetMessage
-                        // the single possible partially deserialized message are held by TransportDeserializer
-                        nSizeAdded += it->m_raw_message_size;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
-                }
-            }
-            else if (nBytes == 0)
-            {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed for peer=%d\n", pnode->GetId());
-                }
-                pnode->CloseSocketDisconnect();
-            }
-            else if (nBytes < 0)
-            {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!pnode->fDisconnect) {
-                        LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(nErr));
-                    }
-                    pnode->CloseSocketDisconnect();
-                }
-            }
+            SocketRecvData(pnode);
         }
 
         //
@@ -1554,6 +1653,129 @@ void CConnman::SocketHandler()
     }
 }
 
+void CConnman::SocketHandlerEpoll()
+{
+#ifdef USE_EPOLL
+    // Same policy as GenerateSelectSet(): don't read from peers we still have
+    // queued data for, or whose receive queue is full.
+    auto recv_ready = [](CNode* pnode) {
+        if (pnode->fPauseRecv) return false;
+        LOCK(pnode->cs_vSend);
+        return pnode->vSendMsg.empty();
+    };
+
+    // epoll only reports the sockets with new activity. Peers that were not
+    // fully read last time won't be reported again, so don't wait if any of
+    // them can be read from right away.
+    bool recv_pending = false;
+    for (CNode* pnode : m_recv_pending) {
+        if (recv_ready(pnode)) {
+            recv_pending = true;
+            break;
+        }
+    }
+
+    struct epoll_event events[MAX_EPOLL_EVENTS];
+    int nEvents = epoll_wait(m_epoll_fd, events, MAX_EPOLL_EVENTS, recv_pending ? 0 : SELECT_TIMEOUT_MILLISECONDS);
+
+    if (interruptNet) return;
+
+    if (nEvents < 0) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll error %s\n", NetworkErrorString(nErr));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS)))
+                return;
+        }
+        nEvents = 0;
+    }
+
+    bool accept = false;
+    std::vector<CNode*> send_nodes;
+    for (int i = 0; i < nEvents; ++i) {
+        CNode* pnode = static_cast<CNode*>(events[i].data.ptr);
+        if (pnode == nullptr) {
+            accept = true;
+            continue;
+        }
+        // Nodes are only deleted by this thread, and closing a socket removes
+        // it from epoll, so any node reported here is still alive.
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+            m_recv_pending.insert(pnode);
+        }
+        if (events[i].events & EPOLLOUT) {
+            send_nodes.push_back(pnode);
+        }
+    }
+
+    //
+    // Accept new connections
+    //
+    if (accept) {
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            if (hListenSocket.socket != INVALID_SOCKET) {
+                AcceptConnection(hListenSocket);
+            }
+        }
+    }
+
+    //
+    // Send, then receive. vSendMsg is normally only left non-empty when the
+    // socket buffer was full, so the socket becoming writable is reported.
+    //
+    for (CNode* pnode : send_nodes) {
+        if (interruptNet) return;
+        LOCK(pnode->cs_vSend);
+        size_t nBytes = SocketSendData(pnode);
+        if (nBytes) {
+            RecordBytesSent(nBytes);
+        }
+    }
+    for (auto it = m_recv_pending.begin(); it != m_recv_pending.end();) {
+        if (interruptNet) return;
+        if (!recv_ready(*it)) {
+            ++it;
+        } else if (SocketRecvData(*it)) {
+            ++it;
+        } else {
+            it = m_recv_pending.erase(it);
+        }
+    }
+
+    //
+    // Idle peers are never visited above, so check all of them for timeouts
+    // once a second instead of on every wakeup. Also retry sends that were
+    // interrupted without filling the socket buffer, which epoll won't report.
+    //
+    int64_t nTime = GetSystemTimeInSeconds();
+    if (nTime != m_last_inactivity_check) {
+        m_last_inactivity_check = nTime;
+        std::vector<CNode*> vNodesCopy;
+        {
+            LOCK(cs_vNodes);
+            vNodesCopy = vNodes;
+            for (CNode* pnode : vNodesCopy)
+                pnode->AddRef();
+        }
+        for (CNode* pnode : vNodesCopy) {
+            {
+                LOCK(pnode->cs_vSend);
+                size_t nBytes = SocketSendData(pnode);
+                if (nBytes) {
+                    RecordBytesSent(nBytes);
+                }
+            }
+            InactivityCheck(pnode);
+        }
+        {
+            LOCK(cs_vNodes);
+            for (CNode* pnode : vNodesCopy)
+                pnode->Release();
+        }
+    }
+#endif
+}
+
 void CConnman::ThreadSocketHandler()
 {
     while (!interruptNet)
@@ -1568,9 +1790,9 @@ void CConnman::WakeMessageHandler()
 {
     {
         LOCK(mutexMsgProc);
-        fMsgProcWake = true;
+        ++nMsgProcWake;
     }
-    condMsgProc.notify_one();
+    condMsgProc.notify_all();
 }
 
 
@@ -2205,21 +2427,25 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         grantOutbound->MoveTo(pnode->grantOutbound);
 
     m_msgproc->InitializeNode(pnode);
+    RegisterSocketEvents(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int shard)
 {
+    uint64_t nLastWake = 0;
     while (!flagInterruptMsgProc)
     {
+        // Only handle the peers assigned to this thread
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            for (CNode* pnode : vNodes) {
+                if (pnode->GetId() % m_msghand_threads != shard) continue;
+                vNodesCopy.push_back(pnode);
                 pnode->AddRef();
             }
         }
@@ -2254,9 +2480,9 @@ void CConnman::ThreadMessageHandler()
 
         WAIT_LOCK(mutexMsgProc, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this]() EXCLUSIVE_LOCKS_REQUIRED(mutexMsgProc) { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [&]() EXCLUSIVE_LOCKS_REQUIRED(mutexMsgProc) { return nMsgProcWake != nLastWake; });
         }
-        fMsgProcWake = false;
+        nLastWake = nMsgProcWake;
     }
 }
 
@@ -2320,6 +2546,21 @@ bool CConnman::BindListenPort(const CService& addrBind, bilingual_str& strError,
         return false;
     }
 
+#ifdef USE_EPOLL
+    if (m_socket_events_mode == SocketEventsMode::EPOLL) {
+        // Listening sockets are level-triggered and marked by a null pointer
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = nullptr;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, hListenSocket, &event) != 0) {
+            strError = strprintf(Untranslated("Error: Couldn't add listening socket to epoll (epoll_ctl returned error %s)"), NetworkErrorString(WSAGetLastError()));
+            LogPrintf("%s\n", strError.original);
+            CloseSocket(hListenSocket);
+            return false;
+        }
+    }
+#endif
+
     vhListenSocket.push_back(ListenSocket(hListenSocket, permissions));
     return true;
 }
@@ -2528,7 +2769,7 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
 
     {
         LOCK(mutexMsgProc);
-        fMsgProcWake = false;
+        nMsgProcWake = 0;
     }
 
     // Send and receive from sockets, accept connections
@@ -2554,7 +2795,12 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < m_msghand_threads; ++i) {
+        threadMessageHandlers.emplace_back([this, i] {
+            const std::string name = m_msghand_threads == 1 ? "msghand" : strprintf("msghand.%d", i);
+            TraceThread(name.c_str(), std::bind(&CConnman::ThreadMessageHandler, this, i));
+        });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery([this] { DumpAddresses(); }, DUMP_PEERS_INTERVAL);
@@ -2603,8 +2849,11 @@ void CConnman::Interrupt()
 
 void CConnman::StopThreads()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2649,6 +2898,7 @@ void CConnman::StopNodes()
     }
     vNodes.clear();
     vNodesDisconnected.clear();
+    m_recv_pending.clear();
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
@@ -2669,6 +2919,11 @@ CConnman::~CConnman()
 {
     Interrupt();
     Stop();
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+    }
+#endif
 }
 
 void CConnman::SetServices(const CService &addr, ServiceFlags nServices)
@@ -2707,6 +2962,7 @@ std::vector<CAddress> CConnman::GetAddresses(CNode& requestor, size_t max_addres
         .Write(local_socket_bytes.data(), local_socket_bytes.size())
         .Finalize();
     const auto current_time = GetTime<std::chrono::microseconds>();
+    LOCK(m_addr_response_caches_mutex);
     auto r = m_addr_response_caches.emplace(cache_id, CachedAddrResponse{});
     CachedAddrResponse& cache_entry = r.first->second;
     if (cache_entry.m_cache_entry_expiration < current_time) { // If emplace() added new one it has expiration 0.
@@ -3007,7 +3263,7 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
 
 void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
+    size_t nMessageSize = msg.Payload().size();
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.m_type), nMessageSize, pnode->GetId());
 
     // make sure we use the appropriate network transport format
@@ -3026,9 +3282,14 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        pnode->vSendMsg.emplace_back(std::move(serializedHeader));
+        if (nMessageSize) {
+            if (msg.m_external_owner) {
+                pnode->vSendMsg.emplace_back(std::move(msg.m_external_owner), msg.m_external_data);
+            } else {
+                pnode->vSendMsg.emplace_back(std::move(msg.data));
+            }
+        }
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
@@ -20,6 +20,7 @@
 #include <policy/feerate.h>
 #include <protocol.h>
 #include <random.h>
+#include <span.h>
 #include <streams.h>
 #include <sync.h>
 #include <threadinterrupt.h>
@@ -88,6 +89,33 @@ static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER    = 1 * 1000;
+/** -msghandthreads default: process the messages of all peers on one thread */
+static const int DEFAULT_MSGHAND_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHAND_THREADS = 16;
+
+/** How the socket handler thread waits for socket activity. */
+enum class SocketEventsMode {
+    SELECT, //!< select() on every socket, on platforms without a usable poll()
+    POLL,   //!< poll() on every socket
+    EPOLL,  //!< edge-triggered epoll, only sockets with new activity are visited
+};
+
+/** -socketevents default */
+#ifdef USE_POLL
+static const SocketEventsMode DEFAULT_SOCKET_EVENTS_MODE = SocketEventsMode::POLL;
+#else
+static const SocketEventsMode DEFAULT_SOCKET_EVENTS_MODE = SocketEventsMode::SELECT;
+#endif
+
+/** Get the name of a socket events mode. */
+const std::string& SocketEventsModeName(SocketEventsMode mode);
+
+/** Find a socket events mode supported on this platform by its name. Return false if there is none. */
+bool SocketEventsModeByName(const std::string& name, SocketEventsMode& mode);
+
+/** Get a comma-separated list of the socket events modes supported on this platform. */
+const std::string& ListSocketEventsModes();
 
 typedef int64_t NodeId;
 
@@ -113,6 +141,28 @@ struct CSerializedNetMsg
 
     std::vector<unsigned char> data;
     std::string m_type;
+    /** Payload living in memory owned elsewhere, such as a mapped block file. Used instead of data when set. */
+    std::shared_ptr<const void> m_external_owner;
+    Span<const unsigned char> m_external_data;
+
+    Span<const unsigned char> Payload() const { return m_external_owner ? m_external_data : MakeSpan(data); }
+};
+
+/** An entry of a peer's send queue. Its bytes are either owned by the entry, or
+ *  refer to memory kept alive by m_owner, so that large payloads need not be copied. */
+class SendQueueEntry
+{
+private:
+    std::vector<unsigned char> m_bytes;
+    std::shared_ptr<const void> m_owner;
+    Span<const unsigned char> m_view;
+
+public:
+    explicit SendQueueEntry(std::vector<unsigned char>&& bytes) : m_bytes(std::move(bytes)) {}
+    SendQueueEntry(std::shared_ptr<const void> owner, Span<const unsigned char> view) : m_owner(std::move(owner)), m_view(view) {}
+
+    const unsigned char* data() const { return m_owner ? m_view.data() : m_bytes.data(); }
+    size_t size() const { return m_owner ? m_view.size() : m_bytes.size(); }
 };
 
 /** Different types of connections to a peer. This enum encapsulates the
@@ -212,6 +262,8 @@ public:
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
+        SocketEventsMode m_socket_events_mode = DEFAULT_SOCKET_EVENTS_MODE;
+        int m_msghand_threads = DEFAULT_MSGHAND_THREADS;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
         std::vector<NetWhitebindPermissions> vWhiteBinds;
@@ -239,6 +291,8 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        InitSocketEvents(connOptions.m_socket_events_mode);
+        m_msghand_threads = std::max(1, std::min(connOptions.m_msghand_threads, MAX_MSGHAND_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -424,14 +478,18 @@ private:
     void AddAddrFetch(const std::string& strDest);
     void ProcessAddrFetch();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int shard);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
+    void InitSocketEvents(SocketEventsMode mode);
+    void RegisterSocketEvents(CNode* pnode);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketHandler();
+    void SocketHandlerEpoll();
+    bool SocketRecvData(CNode* pnode);
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -493,6 +551,19 @@ private:
     unsigned int nSendBufferMaxSize{0};
     unsigned int nReceiveFloodSize{0};
 
+    SocketEventsMode m_socket_events_mode{DEFAULT_SOCKET_EVENTS_MODE};
+    /** epoll instance the listening and peer sockets are registered with in EPOLL mode, or -1 */
+    int m_epoll_fd{-1};
+    /**
+     * Peers whose last read filled the whole receive buffer, or which could not
+     * be read from at the time, so that their socket may still hold data that
+     * edge-triggered epoll will not report again. Only accessed by the socket
+     * handler thread.
+     */
+    std::set<CNode*> m_recv_pending;
+    /** Time of the last sweep over all peers for timeouts in EPOLL mode */
+    int64_t m_last_inactivity_check{0};
+
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive{true};
     bool fAddressesInitialized{false};
@@ -532,7 +603,8 @@ private:
      * resulting in at most ~196 KB. Every separate local socket may
      * add up to ~196 KB extra.
      */
-    std::map<uint64_t, CachedAddrResponse> m_addr_response_caches;
+    Mutex m_addr_response_caches_mutex;
+    std::map<uint64_t, CachedAddrResponse> m_addr_response_caches GUARDED_BY(m_addr_response_caches_mutex);
 
     /**
      * Services this instance offers.
@@ -578,8 +650,11 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake GUARDED_BY(mutexMsgProc);
+    /**
+     * Counter for waking the message processors. Each of them remembers the
+     * value it last saw, so a single wake-up reaches all of them.
+     */
+    uint64_t nMsgProcWake GUARDED_BY(mutexMsgProc){0};
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
@@ -591,7 +666,12 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    /**
+     * Message handler threads. Peers are assigned to them by NodeId, so the
+     * messages of any one peer are always processed in order on one thread.
+     */
+    std::vector<std::thread> threadMessageHandlers;
+    int m_msghand_threads{DEFAULT_MSGHAND_THREADS};
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of m_max_outbound_full_relay
@@ -852,7 +932,7 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<SendQueueEntry> vSendMsg GUARDED_BY(cs_vSend);
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -986,8 +1066,11 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    std::unique_ptr<CRollingBloomFilter> m_addr_known{nullptr};
+    // Addresses are queued for a peer while processing messages of other
+    // peers, which may happen on another message handler thread.
+    Mutex m_addr_send_mutex;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(m_addr_send_mutex);
+    std::unique_ptr<CRollingBloomFilter> m_addr_known PT_GUARDED_BY(m_addr_send_mutex){nullptr};
     bool fGetAddr{false};
     std::chrono::microseconds m_next_addr_send GUARDED_BY(cs_sendProcessing){0};
     std::chrono::microseconds m_next_local_addr_send GUARDED_BY(cs_sendProcessing){0};
@@ -1149,6 +1232,7 @@ public:
     void AddAddressKnown(const CAddress& _addr)
     {
         assert(m_addr_known);
+        LOCK(m_addr_send_mutex);
         m_addr_known->insert(_addr.GetKey());
     }
 
@@ -1163,6 +1247,7 @@ public:
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
         assert(m_addr_known);
+        LOCK(m_addr_send_mutex);
         if (_addr.IsValid() && !m_addr_known->contains(_addr.GetKey()) && addr_format_supported) {
             if (vAddrToSend.size() >= MAX_ADDR_TO_SEND) {
                 vAddrToSend[insecure_rand.randrange(vAddrToSend.size())] = _addr;
@@ -761,6 +761,36 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
     }
 }
 
+/** While a UTXO snapshot is validated in the background, the active chain
+ *  already contains the blocks below the snapshot base block, so
+ *  FindNextBlocksToDownload() never asks for them. Request the ones the
+ *  background chainstate needs next, in a window after its tip. */
+static void FindNextHistoricalBlocksToDownload(const ChainstateManager& chainman, NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (count == 0 || !chainman.IsSnapshotActive() || chainman.IsSnapshotValidated())
+        return;
+
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    const CBlockIndex* snapshot_base = LookupBlockIndex(*chainman.SnapshotBlockhash());
+    const CBlockIndex* background_tip = chainman.ValidatedTip();
+    if (snapshot_base == nullptr || background_tip == nullptr || state->pindexBestKnownBlock == nullptr ||
+        state->pindexBestKnownBlock->GetAncestor(snapshot_base->nHeight) != snapshot_base) {
+        return;
+    }
+
+    const int max_height = std::min<int>(background_tip->nHeight + BLOCK_DOWNLOAD_WINDOW, snapshot_base->nHeight);
+    for (int height = background_tip->nHeight + 1; height <= max_height && vBlocks.size() < count; ++height) {
+        const CBlockIndex* pindex = snapshot_base->GetAncestor(height);
+        if (!State(nodeid)->fHaveWitness && IsWitnessEnabled(pindex->pprev, consensusParams)) {
+            // We wouldn't download this block or its descendants from this peer.
+            return;
+        }
+        if (pindex->nStatus & BLOCK_HAVE_DATA || mapBlocksInFlight.count(pindex->GetBlockHash())) continue;
+        vBlocks.push_back(pindex);
+    }
+}
+
 } // namespace
 
 void PeerManager::AddTxAnnouncement(const CNode& node, const GenTxid& gtxid, std::chrono::microseconds current_time)
@@ -1561,12 +1591,19 @@ void static ProcessGetBlockData(CNode& pfrom, const CChainParams& chainparams, c
             pblock = a_recent_block;
         } else if (inv.IsMsgWitnessBlk()) {
             // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
-                assert(!"cannot load block from disk");
+            // as the network format matches the format on disk. Preferably it is queued
+            // as a view into the mapped block file, so it is not copied at all.
+            std::shared_ptr<const void> block_file;
+            Span<const uint8_t> mapped_block;
+            if (MapRawBlockFromDisk(block_file, mapped_block, pindex, chainparams.MessageStart())) {
+                connman.PushMessage(&pfrom, msgMaker.MakeExternal(NetMsgType::BLOCK, std::move(block_file), mapped_block));
+            } else {
+                std::vector<uint8_t> block_data;
+                if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
+                    assert(!"cannot load block from disk");
+                }
+                connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
             }
-            connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
             // Don't set pblock as we've sent the block
         } else {
             // Send block from disk
@@ -2271,6 +2308,21 @@ static void ProcessGetCFCheckPt(CNode& peer, CDataStream& vRecv, const CChainPar
     connman.PushMessage(&peer, std::move(msg));
 }
 
+/**
+ * Whether a message can be processed concurrently with the messages of peers
+ * handled by other message handler threads. These only touch state of the
+ * peer itself and state that is protected by its own locks, and never change
+ * the chainstate or the mempool.
+ */
+static bool IsParallelMessage(const std::string& msg_type)
+{
+    return msg_type == NetMsgType::ADDR || msg_type == NetMsgType::ADDRV2 || msg_type == NetMsgType::GETADDR ||
+           msg_type == NetMsgType::INV || msg_type == NetMsgType::GETDATA ||
+           msg_type == NetMsgType::PING || msg_type == NetMsgType::PONG ||
+           msg_type == NetMsgType::FILTERLOAD || msg_type == NetMsgType::FILTERADD || msg_type == NetMsgType::FILTERCLEAR ||
+           msg_type == NetMsgType::FEEFILTER;
+}
+
 void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDataStream& vRecv,
                                          const std::chrono::microseconds time_received,
                                          const std::atomic<bool>& interruptMsgProc)
@@ -3498,6 +3550,10 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom.GetId());
 
+        // Use the mempool's copies of the transactions we already have.
+        const size_t shared = m_mempool.ShareTransactions(pblock->vtx);
+        LogPrint(BCLog::NET, "block %s shares %u of %u transactions with the mempool\n", pblock->GetHash().ToString(), shared, pblock->vtx.size());
+
         bool forceProcessing = false;
         const uint256 hash(pblock->GetHash());
         {
@@ -3540,7 +3596,7 @@ void PeerManager::ProcessMessage(CNode& pfrom, const std::string& msg_type, CDat
         }
         pfrom.fSentAddr = true;
 
-        pfrom.vAddrToSend.clear();
+        WITH_LOCK(pfrom.m_addr_send_mutex, pfrom.vAddrToSend.clear());
         std::vector<CAddress> vAddr;
         if (pfrom.HasPermission(PF_ADDR)) {
             vAddr = m_connman.GetAddresses(MAX_ADDR_TO_SEND, MAX_PCT_ADDR_TO_SEND);
@@ -3826,11 +3882,10 @@ bool PeerManager::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgP
         }
     }
 
-    {
+    if (WITH_LOCK(g_cs_orphans, return !peer->m_orphan_work_set.empty())) {
+        LOCK(m_msgproc_serial_mutex);
         LOCK2(cs_main, g_cs_orphans);
-        if (!peer->m_orphan_work_set.empty()) {
-            ProcessOrphanTx(peer->m_orphan_work_set);
-        }
+        ProcessOrphanTx(peer->m_orphan_work_set);
     }
 
     if (pfrom->fDisconnect)
@@ -3872,7 +3927,12 @@ bool PeerManager::ProcessMessages(CNode* pfrom, std::atomic<bool>& interruptMsgP
     unsigned int nMessageSize = msg.m_message_size;
 
     try {
-        ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        if (IsParallelMessage(msg_type)) {
+            ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        } else {
+            LOCK(m_msgproc_serial_mutex);
+            ProcessMessage(*pfrom, msg_type, msg.m_recv, msg.m_time, interruptMsgProc);
+        }
         if (interruptMsgProc) return false;
         {
             LOCK(peer->m_getdata_requests_mutex);
@@ -4043,6 +4103,7 @@ public:
 
 bool PeerManager::SendMessages(CNode* pto)
 {
+    LOCK(m_msgproc_serial_mutex);
     const Consensus::Params& consensusParams = m_chainparams.GetConsensus();
 
     // We must call MaybeDiscourageAndDisconnect first, to ensure that we'll
@@ -4102,6 +4163,7 @@ bool PeerManager::SendMessages(CNode* pto)
         // Message: addr
         //
         if (pto->RelayAddrsWithConn() && pto->m_next_addr_send < current_time) {
+            LOCK(pto->m_addr_send_mutex);
             pto->m_next_addr_send = PoissonNextSend(current_time, AVG_ADDRESS_BROADCAST_INTERVAL);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
@@ -4532,6 +4594,7 @@ bool PeerManager::SendMessages(CNode* pto)
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
             FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextHistoricalBlocksToDownload(m_chainman, pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(*pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
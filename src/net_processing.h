@@ -142,6 +142,13 @@ private:
     CTxMemPool& m_mempool;
     TxRequestTracker m_txrequest GUARDED_BY(::cs_main);
 
+    /**
+     * Serializes the processing of messages that may change the chainstate or
+     * the mempool, and of SendMessages, across message handler threads.
+     * Always acquired before cs_main.
+     */
+    Mutex m_msgproc_serial_mutex;
+
     int64_t m_stale_tip_check_time; //!< Next time to check for stale tip
 };
 
@@ -29,6 +29,16 @@ public:
         return Make(0, std::move(msg_type), std::forward<Args>(args)...);
     }
 
+    /** Make a message from an already serialized payload kept alive by owner, without copying it. */
+    CSerializedNetMsg MakeExternal(std::string msg_type, std::shared_ptr<const void> owner, Span<const unsigned char> payload) const
+    {
+        CSerializedNetMsg msg;
+        msg.m_type = std::move(msg_type);
+        msg.m_external_owner = std::move(owner);
+        msg.m_external_data = payload;
+        return msg;
+    }
+
 private:
     const int nVersion;
 };
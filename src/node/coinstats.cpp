@@ -6,15 +6,27 @@
 #include <node/coinstats.h>
 
 #include <coins.h>
+#include <crypto/muhash.h>
 #include <hash.h>
 #include <serialize.h>
+#include <sync.h>
 #include <uint256.h>
 #include <util/system.h>
 #include <validation.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <map>
+#include <thread>
 
-static uint64_t GetBogoSize(const CScript& scriptPubKey)
+/** The coins database is scanned in this many ranges of transaction ids. */
+static constexpr int SCAN_RANGES = 1024;
+/** The number of threads scanning ranges at most. */
+static constexpr int MAX_SCAN_THREADS = 8;
+/** How many ranges each thread may scan ahead of the one being hashed. */
+static constexpr int SCAN_RANGES_AHEAD_PER_THREAD = 2;
+
+uint64_t GetBogoSize(const CScript& scriptPubKey)
 {
     return 32 /* txid */ +
            4 /* vout index */ +
@@ -24,26 +36,54 @@ static uint64_t GetBogoSize(const CScript& scriptPubKey)
            scriptPubKey.size() /* scriptPubKey */;
 }
 
-static void ApplyStats(CCoinsStats& stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+CDataStream TxOutSer(const COutPoint& outpoint, const Coin& coin)
+{
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << static_cast<uint32_t>(coin.nHeight * 2 + coin.fCoinBase);
+    ss << coin.out;
+    return ss;
+}
+
+template <typename Stream>
+static void SerializeOutputs(Stream& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
-    assert(!outputs.empty());
     ss << hash;
     ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
-    stats.nTransactions++;
     for (const auto& output : outputs) {
         ss << VARINT(output.first + 1);
         ss << output.second.out.scriptPubKey;
         ss << VARINT_MODE(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += GetBogoSize(output.second.out.scriptPubKey);
     }
     ss << VARINT(0u);
 }
 
-static void ApplyStats(CCoinsStats& stats, std::nullptr_t, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+static void ApplyHash(CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    SerializeOutputs(ss, hash, outputs);
+}
+
+//! A range of the legacy hash input is serialized to be hashed later, in order.
+static void ApplyHash(CVectorWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    SerializeOutputs(ss, hash, outputs);
+}
+
+static void ApplyHash(MuHash3072& muhash, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    for (const auto& output : outputs) {
+        const COutPoint outpoint{hash, output.first};
+        muhash.Insert(MakeUCharSpan(TxOutSer(outpoint, output.second)));
+    }
+}
+
+static void ApplyHash(std::nullptr_t, const uint256& hash, const std::map<uint32_t, Coin>& outputs) {}
+
+template <typename T>
+static void ApplyStats(CCoinsStats& stats, T& hash_obj, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
 {
     assert(!outputs.empty());
+    ApplyHash(hash_obj, hash, outputs);
     stats.nTransactions++;
     for (const auto& output : outputs) {
         stats.nTransactionOutputs++;
@@ -52,6 +92,179 @@ static void ApplyStats(CCoinsStats& stats, std::nullptr_t, const uint256& hash,
     }
 }
 
+/** The range a transaction's coins belong to, by the first two bytes of its id (the database's key order). */
+static int RangeOf(const uint256& txid)
+{
+    return ((txid.begin()[0] << 8) | txid.begin()[1]) * SCAN_RANGES >> 16;
+}
+
+/** The smallest transaction id in a range. */
+static uint256 RangeStart(int range)
+{
+    const uint32_t prefix = (uint32_t)range * 0x10000 / SCAN_RANGES;
+    uint256 start;
+    start.begin()[0] = prefix >> 8;
+    start.begin()[1] = prefix & 0xff;
+    return start;
+}
+
+/**
+ * Apply the coins from the cursor's position on, until the first one outside
+ * the range, or all of them if the range is negative. Returns false if reading
+ * a coin failed, or if stopped.
+ */
+template <typename T>
+static bool ScanCoins(CCoinsViewCursor& cursor, int range, CCoinsStats& stats, T& hash_obj, const std::function<bool()>& stop)
+{
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    while (cursor.Valid()) {
+        if (stop()) return false;
+        COutPoint key;
+        Coin coin;
+        if (!cursor.GetKey(key) || !cursor.GetValue(coin)) {
+            return error("%s: unable to read value", __func__);
+        }
+        if (range >= 0 && RangeOf(key.hash) != range) break;
+        if (!outputs.empty() && key.hash != prevkey) {
+            ApplyStats(stats, hash_obj, prevkey, outputs);
+            outputs.clear();
+        }
+        prevkey = key.hash;
+        outputs[key.n] = std::move(coin);
+        stats.coins_count++;
+        cursor.Next();
+    }
+    if (!outputs.empty()) {
+        ApplyStats(stats, hash_obj, prevkey, outputs);
+    }
+    return true;
+}
+
+/** The statistics of a range of the coins, and its part of the hash. */
+struct ScanRange {
+    CCoinsStats stats;
+    //! The legacy hash input of the range
+    std::vector<unsigned char> serialized;
+    MuHash3072 muhash;
+    bool done{false};
+    bool ok{false};
+};
+
+static bool ScanRangeCoins(CCoinsViewCursor& cursor, int range, ScanRange& result, CHashWriter&, const std::function<bool()>& stop)
+{
+    CVectorWriter ss(SER_GETHASH, PROTOCOL_VERSION, result.serialized, 0);
+    return ScanCoins(cursor, range, result.stats, ss, stop);
+}
+
+static bool ScanRangeCoins(CCoinsViewCursor& cursor, int range, ScanRange& result, MuHash3072&, const std::function<bool()>& stop)
+{
+    return ScanCoins(cursor, range, result.stats, result.muhash, stop);
+}
+
+static bool ScanRangeCoins(CCoinsViewCursor& cursor, int range, ScanRange& result, std::nullptr_t, const std::function<bool()>& stop)
+{
+    std::nullptr_t hash_obj{nullptr};
+    return ScanCoins(cursor, range, result.stats, hash_obj, stop);
+}
+
+static void MergeHash(CHashWriter& ss, const ScanRange& range)
+{
+    ss.write((const char*)range.serialized.data(), range.serialized.size());
+}
+
+static void MergeHash(MuHash3072& muhash, const ScanRange& range)
+{
+    muhash *= range.muhash;
+}
+
+static void MergeHash(std::nullptr_t, const ScanRange& range) {}
+
+/**
+ * Apply all coins, scanning ranges of them on several threads, with cursors
+ * cloned from the given one, so they see the same state. The ranges are
+ * merged in order, so a hash over the serialized coins comes out the same as
+ * when they are scanned in one go.
+ */
+template <typename T>
+static bool ScanCoinsParallel(const CCoinsViewCursor& cursor, CCoinsStats& stats, T& hash_obj, const std::function<void()>& interruption_point)
+{
+    const int num_threads = std::max(1, std::min(GetNumCores(), MAX_SCAN_THREADS));
+    const int ranges_ahead = num_threads * SCAN_RANGES_AHEAD_PER_THREAD;
+
+    std::vector<ScanRange> ranges(SCAN_RANGES);
+    Mutex mutex;
+    std::condition_variable cond;
+    int next_range{0};
+    int merged_ranges{0};
+    std::atomic<bool> stop{false};
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(&TraceThread<std::function<void()>>, "coinstats", [&] {
+            std::unique_ptr<CCoinsViewCursor> range_cursor(cursor.Clone());
+            while (true) {
+                int range;
+                {
+                    WAIT_LOCK(mutex, lock);
+                    cond.wait(lock, [&] {
+                        return stop || next_range == SCAN_RANGES || next_range < merged_ranges + ranges_ahead;
+                    });
+                    if (stop || next_range == SCAN_RANGES) return;
+                    range = next_range++;
+                }
+                range_cursor->Seek(RangeStart(range));
+                const bool ok = ScanRangeCoins(*range_cursor, range, ranges[range], hash_obj, [&] { return stop.load(); });
+                {
+                    LOCK(mutex);
+                    ranges[range].ok = ok;
+                    ranges[range].done = true;
+                }
+                cond.notify_all();
+            }
+        });
+    }
+    auto join = [&] {
+        stop = true;
+        cond.notify_all();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    };
+
+    bool ok = true;
+    try {
+        for (int range = 0; range < SCAN_RANGES && ok; ++range) {
+            interruption_point();
+            {
+                WAIT_LOCK(mutex, lock);
+                cond.wait(lock, [&] { return ranges[range].done; });
+            }
+            ok = ranges[range].ok;
+            if (ok) {
+                const ScanRange& result = ranges[range];
+                MergeHash(hash_obj, result);
+                stats.nTransactions += result.stats.nTransactions;
+                stats.nTransactionOutputs += result.stats.nTransactionOutputs;
+                stats.nBogoSize += result.stats.nBogoSize;
+                stats.nTotalAmount += result.stats.nTotalAmount;
+                stats.coins_count += result.stats.coins_count;
+            }
+            ranges[range] = ScanRange{};
+            {
+                LOCK(mutex);
+                ++merged_ranges;
+            }
+            cond.notify_all();
+        }
+    } catch (...) {
+        join();
+        throw;
+    }
+    join();
+    return ok;
+}
+
 //! Calculate statistics about the unspent transaction output set
 template <typename T>
 static bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, T hash_obj, const std::function<void()>& interruption_point)
@@ -68,27 +281,11 @@ static bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, T hash_obj, const
 
     PrepareHash(hash_obj, stats);
 
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, hash_obj, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-            stats.coins_count++;
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, hash_obj, prevkey, outputs);
+    if (std::unique_ptr<CCoinsViewCursor>(pcursor->Clone())) {
+        // The cursor can be cloned to scan ranges of the coins in parallel.
+        if (!ScanCoinsParallel(*pcursor, stats, hash_obj, interruption_point)) return false;
+    } else {
+        if (!ScanCoins(*pcursor, /* range */ -1, stats, hash_obj, [&] { interruption_point(); return false; })) return false;
     }
 
     FinalizeHash(hash_obj, stats);
@@ -104,6 +301,10 @@ bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, CoinStatsHashType hash_t
         CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
         return GetUTXOStats(view, stats, ss, interruption_point);
     }
+    case(CoinStatsHashType::MUHASH): {
+        MuHash3072 muhash;
+        return GetUTXOStats(view, stats, muhash, interruption_point);
+    }
     case(CoinStatsHashType::NONE): {
         return GetUTXOStats(view, stats, nullptr, interruption_point);
     }
@@ -116,10 +317,15 @@ static void PrepareHash(CHashWriter& ss, CCoinsStats& stats)
 {
     ss << stats.hashBlock;
 }
+static void PrepareHash(MuHash3072& muhash, CCoinsStats& stats) {}
 static void PrepareHash(std::nullptr_t, CCoinsStats& stats) {}
 
 static void FinalizeHash(CHashWriter& ss, CCoinsStats& stats)
 {
     stats.hashSerialized = ss.GetHash();
 }
+static void FinalizeHash(MuHash3072& muhash, CCoinsStats& stats)
+{
+    muhash.Finalize(stats.hashSerialized);
+}
 static void FinalizeHash(std::nullptr_t, CCoinsStats& stats) {}
@@ -7,15 +7,20 @@
 #define BITCOIN_NODE_COINSTATS_H
 
 #include <amount.h>
+#include <streams.h>
 #include <uint256.h>
 
 #include <cstdint>
 #include <functional>
 
 class CCoinsView;
+class COutPoint;
+class CScript;
+class Coin;
 
 enum class CoinStatsHashType {
     HASH_SERIALIZED,
+    MUHASH,
     NONE,
 };
 
@@ -32,9 +37,18 @@ struct CCoinsStats
 
     //! The number of coins contained.
     uint64_t coins_count{0};
+
+    //! Whether the stats were looked up in the coin stats index, which does not
+    //! track nTransactions, nDiskSize and coins_count.
+    bool from_index{false};
 };
 
 //! Calculate statistics about the unspent transaction output set
 bool GetUTXOStats(CCoinsView* view, CCoinsStats& stats, const CoinStatsHashType hash_type, const std::function<void()>& interruption_point = {});
 
+uint64_t GetBogoSize(const CScript& scriptPubKey);
+
+//! Serialize a coin the way it is hashed into the MuHash of the UTXO set.
+CDataStream TxOutSer(const COutPoint& outpoint, const Coin& coin);
+
 #endif // BITCOIN_NODE_COINSTATS_H
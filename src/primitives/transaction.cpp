@@ -5,11 +5,15 @@
 
 #include <primitives/transaction.h>
 
+#include <crypto/sha256.h>
 #include <hash.h>
+#include <streams.h>
 #include <tinyformat.h>
 #include <util/strencodings.h>
 
 #include <assert.h>
+#include <string.h>
+#include <thread>
 
 std::string COutPoint::ToString() const
 {
@@ -71,16 +75,81 @@ uint256 CTransaction::ComputeHash() const
 
 uint256 CTransaction::ComputeWitnessHash() const
 {
-    if (!HasWitness()) {
-        return hash;
-    }
     return SerializeHash(*this, SER_GETHASH, 0);
 }
 
+void CTransaction::ComputeHashes() const
+{
+    uint8_t state = UNHASHED;
+    if (m_hash_state.compare_exchange_strong(state, HASHING, std::memory_order_acquire)) {
+        hash = ComputeHash();
+        m_witness_hash = HasWitness() ? ComputeWitnessHash() : hash;
+        m_hash_state.store(HASHED, std::memory_order_release);
+        return;
+    }
+    while (m_hash_state.load(std::memory_order_acquire) != HASHED) {
+        std::this_thread::yield();
+    }
+}
+
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), hash{}, m_witness_hash{} {}
-CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
-CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), hash{ComputeHash()}, m_witness_hash{ComputeWitnessHash()} {}
+CTransaction::CTransaction() : vin(), vout(), nVersion(CTransaction::CURRENT_VERSION), nLockTime(0), m_hash_state{HASHED}, hash{}, m_witness_hash{} {}
+CTransaction::CTransaction(const CMutableTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), m_hash_state{UNHASHED} {}
+CTransaction::CTransaction(CMutableTransaction&& tx) : vin(std::move(tx.vin)), vout(std::move(tx.vout)), nVersion(tx.nVersion), nLockTime(tx.nLockTime), m_hash_state{UNHASHED} {}
+CTransaction::CTransaction(const CTransaction& tx) : vin(tx.vin), vout(tx.vout), nVersion(tx.nVersion), nLockTime(tx.nLockTime), m_hash_state{HASHED}, hash{tx.GetHash()}, m_witness_hash{tx.GetWitnessHash()} {}
+
+void HashTransactions(const std::vector<CTransactionRef>& txs)
+{
+    // Claim the transactions nobody has hashed yet.
+    std::vector<const CTransaction*> claimed;
+    size_t size = 0;
+    for (const CTransactionRef& tx : txs) {
+        uint8_t state = CTransaction::UNHASHED;
+        if (tx->m_hash_state.compare_exchange_strong(state, CTransaction::HASHING, std::memory_order_acquire)) {
+            claimed.push_back(tx.get());
+            size += GetSerializeSize(*tx, PROTOCOL_VERSION);
+        }
+    }
+    if (claimed.empty()) return;
+
+    // Serialize them the way they are hashed, without and (when they have
+    // one) with their witness, into one buffer.
+    std::vector<unsigned char> buffer;
+    buffer.reserve(2 * size);
+    std::vector<size_t> offsets{0};
+    std::vector<size_t> witness_indexes;
+    for (const CTransaction* tx : claimed) {
+        CVectorWriter{SER_GETHASH, SERIALIZE_TRANSACTION_NO_WITNESS, buffer, buffer.size(), *tx};
+        offsets.push_back(buffer.size());
+    }
+    for (size_t i = 0; i < claimed.size(); ++i) {
+        if (!claimed[i]->HasWitness()) continue;
+        CVectorWriter{SER_GETHASH, 0, buffer, buffer.size(), *claimed[i]};
+        offsets.push_back(buffer.size());
+        witness_indexes.push_back(i);
+    }
+
+    const size_t count = offsets.size() - 1;
+    std::vector<const unsigned char*> inputs(count);
+    std::vector<size_t> lengths(count);
+    for (size_t n = 0; n < count; ++n) {
+        inputs[n] = buffer.data() + offsets[n];
+        lengths[n] = offsets[n + 1] - offsets[n];
+    }
+    std::vector<unsigned char> digests(count * CSHA256::OUTPUT_SIZE);
+    SHA256DBatch(digests.data(), inputs.data(), lengths.data(), count);
+
+    for (size_t i = 0; i < claimed.size(); ++i) {
+        memcpy(claimed[i]->hash.begin(), digests.data() + i * CSHA256::OUTPUT_SIZE, CSHA256::OUTPUT_SIZE);
+        claimed[i]->m_witness_hash = claimed[i]->hash;
+    }
+    for (size_t n = 0; n < witness_indexes.size(); ++n) {
+        memcpy(claimed[witness_indexes[n]]->m_witness_hash.begin(), digests.data() + (claimed.size() + n) * CSHA256::OUTPUT_SIZE, CSHA256::OUTPUT_SIZE);
+    }
+    for (const CTransaction* tx : claimed) {
+        tx->m_hash_state.store(CTransaction::HASHED, std::memory_order_release);
+    }
+}
 
 CAmount CTransaction::GetValueOut() const
 {
@@ -12,7 +12,10 @@
 #include <serialize.h>
 #include <uint256.h>
 
+#include <atomic>
+#include <memory>
 #include <tuple>
+#include <vector>
 
 /**
  * A flag that is ORed into the protocol version to designate that a transaction
@@ -279,12 +282,19 @@ public:
     const uint32_t nLockTime;
 
 private:
-    /** Memory only. */
-    const uint256 hash;
-    const uint256 m_witness_hash;
+    /** Memory only. The hashes are computed when first asked for (or by
+     *  HashTransactions), and only read once m_hash_state is HASHED. */
+    enum : uint8_t { UNHASHED, HASHING, HASHED };
+    mutable std::atomic<uint8_t> m_hash_state;
+    mutable uint256 hash;
+    mutable uint256 m_witness_hash;
 
     uint256 ComputeHash() const;
     uint256 ComputeWitnessHash() const;
+    /** Compute both hashes, or wait for the thread that is computing them. */
+    void ComputeHashes() const;
+
+    friend void HashTransactions(const std::vector<std::shared_ptr<const CTransaction>>& txs);
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -293,6 +303,7 @@ public:
     /** Convert a CMutableTransaction into a CTransaction. */
     explicit CTransaction(const CMutableTransaction &tx);
     CTransaction(CMutableTransaction &&tx);
+    CTransaction(const CTransaction& tx);
 
     template <typename Stream>
     inline void Serialize(Stream& s) const {
@@ -308,8 +319,16 @@ public:
         return vin.empty() && vout.empty();
     }
 
-    const uint256& GetHash() const { return hash; }
-    const uint256& GetWitnessHash() const { return m_witness_hash; };
+    const uint256& GetHash() const
+    {
+        if (m_hash_state.load(std::memory_order_acquire) != HASHED) ComputeHashes();
+        return hash;
+    }
+    const uint256& GetWitnessHash() const
+    {
+        if (m_hash_state.load(std::memory_order_acquire) != HASHED) ComputeHashes();
+        return m_witness_hash;
+    }
 
     // Return sum of txouts.
     CAmount GetValueOut() const;
@@ -328,12 +347,12 @@ public:
 
     friend bool operator==(const CTransaction& a, const CTransaction& b)
     {
-        return a.hash == b.hash;
+        return a.GetHash() == b.GetHash();
     }
 
     friend bool operator!=(const CTransaction& a, const CTransaction& b)
     {
-        return a.hash != b.hash;
+        return a.GetHash() != b.GetHash();
     }
 
     std::string ToString() const;
@@ -396,6 +415,9 @@ typedef std::shared_ptr<const CTransaction> CTransactionRef;
 static inline CTransactionRef MakeTransactionRef() { return std::make_shared<const CTransaction>(); }
 template <typename Tx> static inline CTransactionRef MakeTransactionRef(Tx&& txIn) { return std::make_shared<const CTransaction>(std::forward<Tx>(txIn)); }
 
+/** Compute the txids and wtxids of the transactions that do not have them yet, all at once (see SHA256DBatch). */
+void HashTransactions(const std::vector<CTransactionRef>& txs);
+
 /** A generic txid reference (txid or wtxid). */
 class GenTxid
 {
@@ -13,6 +13,10 @@ namespace
 {
 /* Global secp256k1_context object used for verification. */
 secp256k1_context* secp256k1_context_verify = nullptr;
+
+/* Scratch space for the multi-multiplication in batch verification of Schnorr
+ * signatures. Batches that need more are verified in several parts. */
+constexpr size_t BATCH_SCRATCH_SIZE = 1 << 20;
 } // namespace
 
 /** This function is taken from the libsecp256k1 distribution and implements
@@ -181,6 +185,37 @@ bool XOnlyPubKey::VerifySchnorr(const uint256& msg, Span<const unsigned char> si
     return secp256k1_schnorrsig_verify(secp256k1_context_verify, sigbytes.data(), msg.begin(), &pubkey);
 }
 
+void BatchSchnorrVerifier::Add(const XOnlyPubKey& pubkey, const uint256& msg, Span<const unsigned char> sigbytes)
+{
+    assert(sigbytes.size() == 64);
+    m_sigs.insert(m_sigs.end(), sigbytes.begin(), sigbytes.end());
+    m_msgs.push_back(msg);
+    m_pubkeys.push_back(pubkey);
+}
+
+bool BatchSchnorrVerifier::Verify() const
+{
+    if (m_msgs.empty()) return true;
+    if (m_msgs.size() == 1) return m_pubkeys[0].VerifySchnorr(m_msgs[0], m_sigs);
+
+    std::vector<secp256k1_xonly_pubkey> pubkeys(m_pubkeys.size());
+    std::vector<const unsigned char*> sig_ptrs, msg_ptrs;
+    std::vector<const secp256k1_xonly_pubkey*> pubkey_ptrs;
+    sig_ptrs.reserve(m_msgs.size());
+    msg_ptrs.reserve(m_msgs.size());
+    pubkey_ptrs.reserve(m_msgs.size());
+    for (size_t i = 0; i < m_msgs.size(); ++i) {
+        if (!secp256k1_xonly_pubkey_parse(secp256k1_context_verify, &pubkeys[i], m_pubkeys[i].data())) return false;
+        sig_ptrs.push_back(m_sigs.data() + 64 * i);
+        msg_ptrs.push_back(m_msgs[i].begin());
+        pubkey_ptrs.push_back(&pubkeys[i]);
+    }
+    secp256k1_scratch_space* scratch = secp256k1_scratch_space_create(secp256k1_context_verify, BATCH_SCRATCH_SIZE);
+    int ret = secp256k1_schnorrsig_verify_batch(secp256k1_context_verify, scratch, sig_ptrs.data(), msg_ptrs.data(), pubkey_ptrs.data(), m_msgs.size());
+    if (scratch) secp256k1_scratch_space_destroy(secp256k1_context_verify, scratch);
+    return ret;
+}
+
 bool XOnlyPubKey::CheckPayToContract(const XOnlyPubKey& base, const uint256& hash, bool parity) const
 {
     secp256k1_xonly_pubkey base_point;
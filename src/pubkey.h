@@ -228,6 +228,26 @@ public:
     size_t size() const { return m_keydata.size(); }
 };
 
+/** Collects Schnorr signature checks to verify them all at once, which is
+ *  considerably faster than verifying them one by one. */
+class BatchSchnorrVerifier
+{
+private:
+    std::vector<unsigned char> m_sigs;
+    std::vector<uint256> m_msgs;
+    std::vector<XOnlyPubKey> m_pubkeys;
+
+public:
+    /** Add a signature check. sigbytes must be exactly 64 bytes. */
+    void Add(const XOnlyPubKey& pubkey, const uint256& msg, Span<const unsigned char> sigbytes);
+
+    /** Verify all added signatures. Returns false if at least one of them
+     *  is invalid, without telling which. */
+    bool Verify() const;
+
+    size_t size() const { return m_msgs.size(); }
+};
+
 struct CExtPubKey {
     unsigned char nDepth;
     unsigned char vchFingerprint[4];
@@ -122,6 +122,8 @@ CoinStatsHashType ParseHashType(const UniValue& param, const CoinStatsHashType d
 
         if (hash_type_input == "hash_serialized_2") {
             return CoinStatsHashType::HASH_SERIALIZED;
+        } else if (hash_type_input == "muhash") {
+            return CoinStatsHashType::MUHASH;
         } else if (hash_type_input == "none") {
             return CoinStatsHashType::NONE;
         } else {
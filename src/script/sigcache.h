@@ -41,13 +41,18 @@ public:
     }
 };
 
+class BatchSchnorrVerifier;
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    //! If set, Schnorr signatures that are not in the cache are added to this
+    //! batch and assumed valid, instead of being verified (or stored) here
+    BatchSchnorrVerifier* m_batch;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, bool storeIn, PrecomputedTransactionData& txdataIn, BatchSchnorrVerifier* batchIn = nullptr) : TransactionSignatureChecker(txToIn, nInIn, amountIn, txdataIn), store(storeIn), m_batch(batchIn) {}
 
     bool VerifyECDSASignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const override;
     bool VerifySchnorrSignature(Span<const unsigned char> sig, const XOnlyPubKey& pubkey, const uint256& sighash) const override;
@@ -55,4 +60,13 @@ public:
 
 void InitSignatureCache();
 
+/** Get the salt of the signature cache and the entries in it that were not used
+ *  by block validation yet, which are mostly those of mempool transactions. */
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries);
+
+/** Salt the signature cache with nonce and add entries previously retrieved
+ *  with GetSignatureCacheEntries. Only call this before the cache is used, as
+ *  changing the salt invalidates any entries already in it. */
+void AddSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
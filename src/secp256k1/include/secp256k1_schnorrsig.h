@@ -104,6 +104,37 @@ SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorrsig_verify(
     const secp256k1_xonly_pubkey *pubkey
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4);
 
+/** Verify a set of Schnorr signatures at once.
+ *
+ *  Checks a random linear combination of the verification equations of all
+ *  signatures with a single multi-multiplication, which is considerably faster
+ *  than verifying them one by one. The random coefficients are derived from a
+ *  hash of all inputs. If this fails, at least one signature is invalid, but
+ *  the function does not tell which one.
+ *
+ *  Returns: 1: all signatures are correct (or n_sigs is 0)
+ *           0: at least one signature is incorrect, or not enough memory
+ *  Args:    ctx: a secp256k1 context object, initialized for verification.
+ *       scratch: scratch space used for the multi-multiplication. If it is NULL
+ *                or too small, the signatures are verified with a slower
+ *                algorithm.
+ *  In:    sig64: array of pointers to the 64-byte signatures to verify (can
+ *                only be NULL if n_sigs is 0)
+ *         msg32: array of pointers to the 32-byte messages being verified
+ *                (can only be NULL if n_sigs is 0)
+ *            pk: array of pointers to the x-only public keys to verify with
+ *                (can only be NULL if n_sigs is 0)
+ *        n_sigs: number of signatures in the above arrays
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_schnorrsig_verify_batch(
+    const secp256k1_context* ctx,
+    secp256k1_scratch_space *scratch,
+    const unsigned char *const *sig64,
+    const unsigned char *const *msg32,
+    const secp256k1_xonly_pubkey *const *pk,
+    size_t n_sigs
+) SECP256K1_ARG_NONNULL(1);
+
 #ifdef __cplusplus
 }
 #endif
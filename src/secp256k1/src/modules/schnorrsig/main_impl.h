@@ -236,4 +236,127 @@ int secp256k1_schnorrsig_verify(const secp256k1_context* ctx, const unsigned cha
            secp256k1_fe_equal_var(&rx, &r.x);
 }
 
+typedef struct {
+    const secp256k1_context *ctx;
+    /* SHA256 state with the seed of the randomizers written to it */
+    secp256k1_sha256 sha;
+    const unsigned char *const *sig64;
+    const unsigned char *const *msg32;
+    const secp256k1_xonly_pubkey *const *pk;
+} secp256k1_schnorrsig_verify_batch_ecmult_data;
+
+/* Derive the randomizer of signature i from the seeded hash. The first one is
+ * 1, which saves a multiplication and does not weaken the batch check. */
+static void secp256k1_schnorrsig_batch_randomizer(secp256k1_scalar *a, const secp256k1_sha256 *seeded, size_t i) {
+    secp256k1_sha256 sha;
+    unsigned char buf[32];
+    int j;
+
+    if (i == 0) {
+        secp256k1_scalar_set_int(a, 1);
+        return;
+    }
+    sha = *seeded;
+    for (j = 0; j < 8; j++) {
+        buf[j] = (i >> (8 * j)) & 0xff;
+    }
+    secp256k1_sha256_write(&sha, buf, 8);
+    secp256k1_sha256_finalize(&sha, buf);
+    secp256k1_scalar_set_b32(a, buf, NULL);
+}
+
+/* Provides the points -a_i*R_i (even idx) and -a_i*e_i*P_i (odd idx) of the
+ * batch equation to the multi-multiplication. */
+static int secp256k1_schnorrsig_verify_batch_ecmult_callback(secp256k1_scalar *sc, secp256k1_ge *pt, size_t idx, void *cbdata) {
+    secp256k1_schnorrsig_verify_batch_ecmult_data *data = (secp256k1_schnorrsig_verify_batch_ecmult_data *) cbdata;
+    size_t i = idx / 2;
+    secp256k1_scalar a;
+
+    secp256k1_schnorrsig_batch_randomizer(&a, &data->sha, i);
+    if (idx % 2 == 0) {
+        secp256k1_fe rx;
+        if (!secp256k1_fe_set_b32(&rx, &data->sig64[i][0])) {
+            return 0;
+        }
+        if (!secp256k1_ge_set_xo_var(pt, &rx, 0)) {
+            return 0;
+        }
+        *sc = a;
+    } else {
+        secp256k1_scalar e;
+        unsigned char buf[32];
+        if (!secp256k1_xonly_pubkey_load(data->ctx, pt, data->pk[i])) {
+            return 0;
+        }
+        secp256k1_fe_get_b32(buf, &pt->x);
+        secp256k1_schnorrsig_challenge(&e, &data->sig64[i][0], data->msg32[i], buf);
+        secp256k1_scalar_mul(sc, &e, &a);
+    }
+    secp256k1_scalar_negate(sc, sc);
+    return 1;
+}
+
+int secp256k1_schnorrsig_verify_batch(const secp256k1_context* ctx, secp256k1_scratch_space *scratch, const unsigned char *const *sig64, const unsigned char *const *msg32, const secp256k1_xonly_pubkey *const *pk, size_t n_sigs) {
+    secp256k1_schnorrsig_verify_batch_ecmult_data data;
+    secp256k1_sha256 sha;
+    unsigned char seed[32];
+    secp256k1_scalar s_sum;
+    secp256k1_gej rj;
+    size_t i;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(n_sigs == 0 || sig64 != NULL);
+    ARG_CHECK(n_sigs == 0 || msg32 != NULL);
+    ARG_CHECK(n_sigs == 0 || pk != NULL);
+    ARG_CHECK(n_sigs <= SIZE_MAX / 2);
+
+    if (n_sigs == 0) {
+        return 1;
+    }
+
+    /* Seed the randomizers with a hash of all signatures, messages and public
+     * keys, so that they cannot be predicted when choosing the inputs. */
+    secp256k1_sha256_initialize(&sha);
+    for (i = 0; i < n_sigs; i++) {
+        secp256k1_ge pk_ge;
+        unsigned char buf[32];
+        if (!secp256k1_xonly_pubkey_load(ctx, &pk_ge, pk[i])) {
+            return 0;
+        }
+        secp256k1_fe_get_b32(buf, &pk_ge.x);
+        secp256k1_sha256_write(&sha, sig64[i], 64);
+        secp256k1_sha256_write(&sha, msg32[i], 32);
+        secp256k1_sha256_write(&sha, buf, 32);
+    }
+    secp256k1_sha256_finalize(&sha, seed);
+    secp256k1_sha256_initialize(&data.sha);
+    secp256k1_sha256_write(&data.sha, seed, 32);
+
+    /* Compute sum(a_i*s_i), the scalar of G */
+    secp256k1_scalar_clear(&s_sum);
+    for (i = 0; i < n_sigs; i++) {
+        secp256k1_scalar s;
+        secp256k1_scalar a;
+        int overflow;
+        secp256k1_scalar_set_b32(&s, &sig64[i][32], &overflow);
+        if (overflow) {
+            return 0;
+        }
+        secp256k1_schnorrsig_batch_randomizer(&a, &data.sha, i);
+        secp256k1_scalar_mul(&s, &s, &a);
+        secp256k1_scalar_add(&s_sum, &s_sum, &s);
+    }
+
+    /* Check sum(a_i*s_i)*G - sum(a_i*R_i) - sum(a_i*e_i*P_i) = 0 */
+    data.ctx = ctx;
+    data.sig64 = sig64;
+    data.msg32 = msg32;
+    data.pk = pk;
+    if (!secp256k1_ecmult_multi_var(&ctx->error_callback, &ctx->ecmult_ctx, scratch, &rj, &s_sum, secp256k1_schnorrsig_verify_batch_ecmult_callback, (void *) &data, 2 * n_sigs)) {
+        return 0;
+    }
+    return secp256k1_gej_is_infinity(&rj);
+}
+
 #endif
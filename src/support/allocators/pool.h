@@ -0,0 +1,255 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * A memory resource similar to std::pmr::unsynchronized_pool_resource, but
+ * optimized for node-based containers such as std::unordered_map, which
+ * allocate all their nodes with the same size.
+ *
+ * Memory is taken from the system in large chunks. Allocations of up to
+ * MAX_BLOCK_SIZE_BYTES are carved out of the current chunk and, once
+ * deallocated, kept in a free list per size so they can be handed out again.
+ * Larger allocations (like the bucket array of a hash map) go straight to
+ * operator new.
+ *
+ * Nothing is given back to the system before the resource is destroyed, which
+ * frees all chunks at once regardless of how many nodes were carved out of
+ * them. Compared to one malloc per node this saves the per-allocation
+ * overhead of the system allocator, keeps the nodes close together in memory
+ * and makes the memory used by the container easy to account for exactly.
+ *
+ * Not thread safe: the owner of the container has to synchronize access.
+ *
+ * @tparam MAX_BLOCK_SIZE_BYTES Largest allocation served from the chunks.
+ * @tparam ALIGN_BYTES          Alignment of all allocations served from the
+ *                              chunks. Allocations with a larger alignment
+ *                              requirement also go to operator new.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource final
+{
+    static_assert(ALIGN_BYTES > 0, "ALIGN_BYTES must be nonzero");
+    static_assert((ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0, "ALIGN_BYTES must be a power of two");
+    static_assert(ALIGN_BYTES <= alignof(std::max_align_t), "ALIGN_BYTES must not exceed what operator new guarantees");
+
+    /** A deallocated block, linked into the free list of its size. */
+    struct ListNode {
+        ListNode* m_next;
+
+        explicit ListNode(ListNode* next) : m_next(next) {}
+    };
+
+    /** Every block is a multiple of this size, and aligned to it. */
+    static constexpr std::size_t ELEM_ALIGN_BYTES = alignof(ListNode) > ALIGN_BYTES ? alignof(ListNode) : ALIGN_BYTES;
+    static_assert(sizeof(ListNode) <= ELEM_ALIGN_BYTES, "a free block must fit a ListNode");
+    static_assert(MAX_BLOCK_SIZE_BYTES % ELEM_ALIGN_BYTES == 0, "MAX_BLOCK_SIZE_BYTES should be a multiple of ALIGN_BYTES");
+
+    /** Size of every chunk taken from the system. */
+    const std::size_t m_chunk_size_bytes;
+
+    /** All chunks taken from the system, released in the destructor. */
+    std::list<char*> m_allocated_chunks{};
+
+    /** Free lists, indexed by the block size in multiples of ELEM_ALIGN_BYTES. */
+    std::array<ListNode*, MAX_BLOCK_SIZE_BYTES / ELEM_ALIGN_BYTES + 1> m_free_lists{};
+
+    /** Unused memory at the end of the current chunk. */
+    char* m_available_memory_it = nullptr;
+    char* m_available_memory_end = nullptr;
+
+    /** Bytes held in the free lists, ready to be handed out again. */
+    std::size_t m_free_list_bytes = 0;
+
+    /** Number of ELEM_ALIGN_BYTES needed to hold the given number of bytes (at least one). */
+    static constexpr std::size_t NumElemAlignBytes(std::size_t bytes)
+    {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (bytes == 0);
+    }
+
+    /** Whether an allocation can be served from the chunks. */
+    static constexpr bool IsFreeListUsable(std::size_t bytes, std::size_t alignment)
+    {
+        return alignment <= ELEM_ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    /** Put the block at p in front of the given free list. */
+    void PlacementAddToList(void* p, ListNode*& node, std::size_t num_alignments)
+    {
+        node = new (p) ListNode{node};
+        m_free_list_bytes += num_alignments * ELEM_ALIGN_BYTES;
+    }
+
+    /** Take a new chunk from the system. What's left of the current one goes into a free list. */
+    void AllocateChunk()
+    {
+        const std::size_t remaining_available_bytes = m_available_memory_end - m_available_memory_it;
+        if (remaining_available_bytes != 0) {
+            const std::size_t num_alignments = remaining_available_bytes / ELEM_ALIGN_BYTES;
+            PlacementAddToList(m_available_memory_it, m_free_lists[num_alignments], num_alignments);
+        }
+
+        m_available_memory_it = static_cast<char*>(::operator new(m_chunk_size_bytes));
+        m_available_memory_end = m_available_memory_it + m_chunk_size_bytes;
+        m_allocated_chunks.emplace_back(m_available_memory_it);
+    }
+
+public:
+    /**
+     * @param[in] chunk_size_bytes  Size of the chunks taken from the system,
+     *                              rounded up to a multiple of ALIGN_BYTES.
+     */
+    explicit PoolResource(std::size_t chunk_size_bytes)
+        : m_chunk_size_bytes(NumElemAlignBytes(chunk_size_bytes) * ELEM_ALIGN_BYTES)
+    {
+        assert(m_chunk_size_bytes >= MAX_BLOCK_SIZE_BYTES);
+        AllocateChunk();
+    }
+
+    /** Use chunks of 256 KiB. */
+    PoolResource() : PoolResource(262144) {}
+
+    PoolResource(const PoolResource&) = delete;
+    PoolResource& operator=(const PoolResource&) = delete;
+
+    /** Release all chunks. Every container using the resource must be gone by now. */
+    ~PoolResource()
+    {
+        for (char* chunk : m_allocated_chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    /** Allocate a block of the given size, from a free list or the current chunk if possible. */
+    void* Allocate(std::size_t bytes, std::size_t alignment)
+    {
+        if (IsFreeListUsable(bytes, alignment)) {
+            const std::size_t num_alignments = NumElemAlignBytes(bytes);
+            ListNode*& free_list = m_free_lists[num_alignments];
+            if (free_list != nullptr) {
+                // Reuse a block of the same size that was deallocated before.
+                ListNode* node = free_list;
+                free_list = node->m_next;
+                m_free_list_bytes -= num_alignments * ELEM_ALIGN_BYTES;
+                return node;
+            }
+
+            const std::size_t round_bytes = num_alignments * ELEM_ALIGN_BYTES;
+            if (round_bytes > static_cast<std::size_t>(m_available_memory_end - m_available_memory_it)) {
+                AllocateChunk();
+            }
+            void* p = m_available_memory_it;
+            m_available_memory_it += round_bytes;
+            return p;
+        }
+
+        assert(alignment <= alignof(std::max_align_t));
+        return ::operator new(bytes);
+    }
+
+    /** Give back a block previously obtained from Allocate() with the same size and alignment. */
+    void Deallocate(void* p, std::size_t bytes, std::size_t alignment) noexcept
+    {
+        if (IsFreeListUsable(bytes, alignment)) {
+            const std::size_t num_alignments = NumElemAlignBytes(bytes);
+            PlacementAddToList(p, m_free_lists[num_alignments], num_alignments);
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    /** Number of chunks taken from the system so far. */
+    std::size_t NumAllocatedChunks() const
+    {
+        return m_allocated_chunks.size();
+    }
+
+    /** Size of every chunk taken from the system. */
+    std::size_t ChunkSizeBytes() const
+    {
+        return m_chunk_size_bytes;
+    }
+
+    /** Bytes of the chunks that were deallocated and wait in the free lists to be reused. */
+    std::size_t FreeListBytes() const
+    {
+        return m_free_list_bytes;
+    }
+};
+
+/**
+ * Allocator that takes its memory from a PoolResource, which it does not own.
+ * Meant for node-based containers; copies (and rebound copies) share the
+ * resource.
+ */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator
+{
+    PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>* m_resource;
+
+    template <typename U, std::size_t M, std::size_t A>
+    friend class PoolAllocator;
+
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    /** Not explicit, so containers can be constructed with a pointer to the resource. */
+    PoolAllocator(ResourceType* resource) noexcept : m_resource(resource) {}
+
+    PoolAllocator(const PoolAllocator& other) noexcept = default;
+    PoolAllocator& operator=(const PoolAllocator& other) noexcept = default;
+
+    template <class U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& other) noexcept : m_resource(other.resource())
+    {
+    }
+
+    /** The rebound allocator keeps the pool parameters, so it is required even though T is the first template parameter. */
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    T* allocate(std::size_t n)
+    {
+        return static_cast<T*>(m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType* resource() const noexcept
+    {
+        return m_resource;
+    }
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator==(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return a.resource() == b.resource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+bool operator!=(const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& a,
+                const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>& b) noexcept
+{
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
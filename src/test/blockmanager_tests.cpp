@@ -0,0 +1,110 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <pow.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+#include <validation.h>
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockmanager_tests, BasicTestingSetup)
+
+/** Build a chain of headers on top of the regtest genesis block, with or without valid proof of work. */
+static std::vector<CBlockHeader> BuildHeaders(const Consensus::Params& consensus, const CBlockHeader& genesis, size_t count, bool valid_pow)
+{
+    std::vector<CBlockHeader> headers{genesis};
+    while (headers.size() < count) {
+        CBlockHeader header = headers.back();
+        header.hashPrevBlock = headers.back().GetHash();
+        header.nTime += 1;
+        header.nBits = UintToArith256(consensus.powLimit).GetCompact();
+        header.nNonce = 0;
+        while (CheckProofOfWork(header.GetHash(), header.nBits, consensus) != valid_pow) {
+            ++header.nNonce;
+        }
+        headers.push_back(header);
+    }
+    return headers;
+}
+
+/** Write the headers to the block tree database, as a chain of header-only block index entries. */
+static void WriteHeaders(CBlockTreeDB& blocktree, const std::vector<CBlockHeader>& headers)
+{
+    std::vector<uint256> hashes;
+    std::vector<CBlockIndex> entries;
+    hashes.reserve(headers.size());
+    entries.reserve(headers.size());
+    for (const CBlockHeader& header : headers) {
+        hashes.push_back(header.GetHash());
+        entries.emplace_back(header);
+        CBlockIndex& entry = entries.back();
+        entry.phashBlock = &hashes.back();
+        entry.pprev = entries.size() > 1 ? &entries[entries.size() - 2] : nullptr;
+        entry.nHeight = entries.size() - 1;
+        entry.nStatus = BLOCK_VALID_TREE;
+    }
+    std::vector<const CBlockIndex*> blockinfo;
+    for (const CBlockIndex& entry : entries) {
+        blockinfo.push_back(&entry);
+    }
+    BOOST_REQUIRE(blocktree.WriteBatchSync({}, 0, blockinfo));
+}
+
+BOOST_AUTO_TEST_CASE(load_block_index)
+{
+    const auto chainparams = CreateChainParams(*m_node.args, CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = chainparams->GetConsensus();
+    // More entries than are hashed in one batch.
+    const std::vector<CBlockHeader> headers = BuildHeaders(consensus, chainparams->GenesisBlock(), 20000, /* valid_pow */ true);
+    CBlockTreeDB blocktree{1 << 20, /* fMemory */ true, /* fWipe */ true};
+    WriteHeaders(blocktree, headers);
+
+    LOCK(cs_main);
+    BlockManager blockman;
+    std::set<CBlockIndex*, CBlockIndexWorkComparator> candidates;
+    BOOST_REQUIRE(blockman.LoadBlockIndex(consensus, blocktree, candidates));
+    BOOST_CHECK_EQUAL(blockman.m_block_index.size(), headers.size());
+    BOOST_CHECK(candidates.empty());
+
+    arith_uint256 chain_work;
+    const CBlockIndex* genesis = blockman.m_block_index.at(headers.front().GetHash());
+    for (size_t height = 0; height < headers.size(); ++height) {
+        const uint256 hash = headers[height].GetHash();
+        const CBlockIndex* pindex = blockman.m_block_index.at(hash);
+        chain_work += GetBlockProof(*pindex);
+        BOOST_CHECK_EQUAL(pindex->GetBlockHash(), hash);
+        BOOST_CHECK_EQUAL(pindex->nHeight, (int)height);
+        BOOST_CHECK_EQUAL(pindex->nNonce, headers[height].nNonce);
+        BOOST_CHECK(pindex->nChainWork == chain_work);
+        BOOST_CHECK_EQUAL(pindex->pprev ? pindex->pprev->GetBlockHash() : uint256(), headers[height].hashPrevBlock);
+        BOOST_CHECK_EQUAL(pindex->GetAncestor(0), genesis);
+    }
+    BOOST_CHECK_EQUAL(pindexBestHeader->GetBlockHash(), headers.back().GetHash());
+
+    blockman.Unload();
+    BOOST_CHECK(blockman.m_block_index.empty());
+    pindexBestHeader = nullptr;
+}
+
+BOOST_AUTO_TEST_CASE(load_block_index_bad_pow)
+{
+    const auto chainparams = CreateChainParams(*m_node.args, CBaseChainParams::REGTEST);
+    const Consensus::Params& consensus = chainparams->GetConsensus();
+    const std::vector<CBlockHeader> headers = BuildHeaders(consensus, chainparams->GenesisBlock(), 2, /* valid_pow */ false);
+    CBlockTreeDB blocktree{1 << 20, /* fMemory */ true, /* fWipe */ true};
+    WriteHeaders(blocktree, headers);
+
+    LOCK(cs_main);
+    BlockManager blockman;
+    std::set<CBlockIndex*, CBlockIndexWorkComparator> candidates;
+    BOOST_CHECK(!blockman.LoadBlockIndex(consensus, blocktree, candidates));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
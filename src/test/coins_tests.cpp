@@ -54,7 +54,7 @@ public:
 
     uint256 GetBestBlock() const override { return hashBestBlock_; }
 
-    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) override
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock, bool erase = true) override
     {
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -65,7 +65,7 @@ public:
                     map_.erase(it->first);
                 }
             }
-            mapCoins.erase(it++);
+            it = erase ? mapCoins.erase(it) : std::next(it);
         }
         if (!hashBlock.IsNull())
             hashBestBlock_ = hashBlock;
@@ -127,6 +127,8 @@ void SimulationTest(CCoinsView* base, bool fake_best_block)
     bool found_an_entry = false;
     bool missed_an_entry = false;
     bool uncached_an_entry = false;
+    bool synced_a_cache = false;
+    bool evicted_an_entry = false;
 
     // A simple map to track what we expect the cache stack to represent.
     std::map<COutPoint, Coin> result;
@@ -217,7 +219,15 @@ void SimulationTest(CCoinsView* base, bool fake_best_block)
             if (stack.size() > 1 && InsecureRandBool() == 0) {
                 unsigned int flushIndex = InsecureRandRange(stack.size() - 1);
                 if (fake_best_block) stack[flushIndex]->SetBestBlock(InsecureRand256());
-                BOOST_CHECK(stack[flushIndex]->Flush());
+                if (InsecureRandBool()) {
+                    BOOST_CHECK(stack[flushIndex]->Flush());
+                } else {
+                    // Keep the coins cached, and evict some of them.
+                    BOOST_CHECK(stack[flushIndex]->Sync());
+                    synced_a_cache = true;
+                    const size_t usage = stack[flushIndex]->DynamicMemoryUsage();
+                    evicted_an_entry |= stack[flushIndex]->EvictColdCoins(usage - std::min<size_t>(usage, InsecureRandRange(4096))) > 0;
+                }
             }
         }
         if (InsecureRandRange(100) == 0) {
@@ -261,6 +271,8 @@ void SimulationTest(CCoinsView* base, bool fake_best_block)
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
     BOOST_CHECK(uncached_an_entry);
+    BOOST_CHECK(synced_a_cache);
+    BOOST_CHECK(evicted_an_entry);
 }
 
 // Run the above simulation for multiple base types.
@@ -271,6 +283,15 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
 
     CCoinsViewDB db_base{"test", /*nCacheSize*/ 1 << 23, /*fMemory*/ true, /*fWipe*/ false};
     SimulationTest(&db_base, true);
+
+    CCoinsViewDB bulk_db_base{"test", /*nCacheSize*/ 1 << 23, /*fMemory*/ true, /*fWipe*/ false};
+    bulk_db_base.StartBulkLoad();
+    SimulationTest(&bulk_db_base, true);
+    bulk_db_base.FinishBulkLoad();
+
+    CCoinsViewDB writer_db_base{"test", /*nCacheSize*/ 1 << 23, /*fMemory*/ true, /*fWipe*/ false};
+    CCoinsViewAsyncWriter writer_base{&writer_db_base};
+    SimulationTest(&writer_base, true);
 }
 
 // Store of all necessary tx and undo data for next test
@@ -609,7 +630,8 @@ void GetCoinsMapEntry(const CCoinsMap& map, CAmount& value, char& flags)
 
 void WriteCoinsViewEntry(CCoinsView& view, CAmount value, char flags)
 {
-    CCoinsMap map;
+    CCoinsMapMemoryResource resource;
+    CCoinsMap map{0, CCoinsMap::hasher{}, CCoinsMap::key_equal{}, &resource};
     InsertCoinsMapEntry(map, value, flags);
     BOOST_CHECK(view.BatchWrite(map, {}));
 }
@@ -793,6 +815,38 @@ BOOST_AUTO_TEST_CASE(ccoins_add)
     CheckAddCoin(VALUE2, VALUE3, VALUE3, DIRTY|FRESH, DIRTY|FRESH, true );
 }
 
+static void CheckEmplaceCoinFromBase(CAmount cache_value, CAmount emplace_value, CAmount expected_value, char cache_flags, char expected_flags)
+{
+    SingleEntryCacheTest test(ABSENT, cache_value, cache_flags);
+    Coin coin;
+    SetCoinsValue(emplace_value, coin);
+    test.cache.EmplaceCoinFromBase(OUTPOINT, std::move(coin));
+    test.cache.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_emplace_from_base)
+{
+    /* Check EmplaceCoinFromBase behavior, inserting a coin that was read from
+     * the base view elsewhere (as the input prefetcher does), and checking
+     * that an existing cache entry is never overwritten.
+     *
+     *                        Cache   Emplace Result  Cache        Result
+     *                        Value   Value   Value   Flags        Flags
+     */
+    CheckEmplaceCoinFromBase(ABSENT, SPENT , ABSENT, NO_ENTRY   , NO_ENTRY   );
+    CheckEmplaceCoinFromBase(ABSENT, VALUE3, VALUE3, NO_ENTRY   , 0          );
+    for (const char cache_flags : FLAGS) {
+        CheckEmplaceCoinFromBase(SPENT , VALUE3, SPENT , cache_flags, cache_flags);
+        CheckEmplaceCoinFromBase(VALUE2, VALUE3, VALUE2, cache_flags, cache_flags);
+    }
+}
+
 void CheckWriteCoins(CAmount parent_value, CAmount child_value, CAmount expected_value, char parent_flags, char child_flags, char expected_flags)
 {
     SingleEntryCacheTest test(ABSENT, parent_value, parent_flags);
@@ -878,4 +932,146 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+static void CheckSyncCoins(CAmount base_value, CAmount cache_value, CAmount expected_base_value, CAmount expected_cache_value, char cache_flags, char expected_base_flags, char expected_cache_flags)
+{
+    SingleEntryCacheTest test(base_value, cache_value, cache_flags);
+    BOOST_CHECK(test.cache.Sync());
+    test.cache.SelfTest();
+    test.base.SelfTest();
+
+    CAmount result_value;
+    char result_flags;
+    GetCoinsMapEntry(test.base.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_base_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_base_flags);
+    GetCoinsMapEntry(test.cache.map(), result_value, result_flags);
+    BOOST_CHECK_EQUAL(result_value, expected_cache_value);
+    BOOST_CHECK_EQUAL(result_flags, expected_cache_flags);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_sync)
+{
+    /* Check Sync behavior, writing one entry from a cache to its base view
+     * while keeping it cached, and checking the resulting entries in both.
+     *
+     *              Base    Cache   Result  Result  Cache        Result       Result
+     *              Value   Value   Base    Cache   Flags        Base Flags   Cache Flags
+     */
+    CheckSyncCoins(ABSENT, ABSENT, ABSENT, ABSENT, NO_ENTRY   , NO_ENTRY   , NO_ENTRY   );
+    CheckSyncCoins(ABSENT, SPENT , ABSENT, ABSENT, 0          , NO_ENTRY   , NO_ENTRY   );
+    CheckSyncCoins(ABSENT, SPENT , ABSENT, ABSENT, FRESH      , NO_ENTRY   , NO_ENTRY   );
+    CheckSyncCoins(ABSENT, SPENT , SPENT , ABSENT, DIRTY      , DIRTY      , NO_ENTRY   );
+    CheckSyncCoins(ABSENT, SPENT , ABSENT, ABSENT, DIRTY|FRESH, NO_ENTRY   , NO_ENTRY   );
+    CheckSyncCoins(ABSENT, VALUE2, ABSENT, VALUE2, 0          , NO_ENTRY   , 0          );
+    CheckSyncCoins(ABSENT, VALUE2, VALUE2, VALUE2, DIRTY      , DIRTY      , 0          );
+    CheckSyncCoins(ABSENT, VALUE2, VALUE2, VALUE2, DIRTY|FRESH, DIRTY|FRESH, 0          );
+    CheckSyncCoins(VALUE1, ABSENT, VALUE1, ABSENT, NO_ENTRY   , DIRTY      , NO_ENTRY   );
+    CheckSyncCoins(VALUE1, SPENT , SPENT , ABSENT, DIRTY      , DIRTY      , NO_ENTRY   );
+    CheckSyncCoins(VALUE1, VALUE1, VALUE1, VALUE1, 0          , DIRTY      , 0          );
+    CheckSyncCoins(VALUE1, VALUE2, VALUE2, VALUE2, DIRTY      , DIRTY      , 0          );
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_evict_cold_coins)
+{
+    CCoinsView root;
+    CCoinsViewCacheTest base{&root};
+    CCoinsViewCacheTest cache{&base};
+
+    std::vector<COutPoint> outpoints;
+    for (uint32_t n = 0; n < 100; ++n) {
+        outpoints.emplace_back(InsecureRand256(), n);
+        Coin coin;
+        SetCoinsValue(VALUE1, coin);
+        cache.AddCoin(outpoints.back(), std::move(coin), /* possible_overwrite */ false);
+    }
+
+    // Modified entries are never evicted.
+    BOOST_CHECK_EQUAL(cache.EvictColdCoins(0), 0U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 100U);
+
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(base.GetCacheSize(), 100U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 100U);
+
+    // All entries were just used, so the sweep first clears all marks before
+    // it evicts anything.
+    const size_t full_usage = cache.DynamicMemoryUsage();
+    BOOST_CHECK_EQUAL(cache.EvictColdCoins(full_usage - 1), 1U);
+    const size_t entry_usage = full_usage - cache.DynamicMemoryUsage();
+    BOOST_CHECK_GT(entry_usage, 0U);
+    cache.SelfTest();
+
+    // Entries used since then survive the next sweep.
+    std::vector<COutPoint> used;
+    for (const COutPoint& outpoint : outpoints) {
+        if (used.size() < 10 && cache.HaveCoinInCache(outpoint)) {
+            BOOST_CHECK(cache.HaveCoin(outpoint));
+            used.push_back(outpoint);
+        }
+    }
+    BOOST_CHECK_EQUAL(cache.EvictColdCoins(cache.DynamicMemoryUsage() - 89 * entry_usage), 89U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 10U);
+    for (const COutPoint& outpoint : used) {
+        BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    }
+    cache.SelfTest();
+
+    // Evicted coins are fetched from the base again.
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(cache.HaveCoin(outpoint));
+    }
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 100U);
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_async_writer)
+{
+    CCoinsViewDB db{"test", /*nCacheSize*/ 1 << 23, /*fMemory*/ true, /*fWipe*/ false};
+    CCoinsViewAsyncWriter writer{&db};
+    CCoinsViewCache cache{&writer};
+
+    std::vector<COutPoint> outpoints;
+    for (uint32_t n = 0; n < 1000; ++n) {
+        outpoints.emplace_back(InsecureRand256(), n);
+        Coin coin;
+        SetCoinsValue(VALUE1, coin);
+        cache.AddCoin(outpoints.back(), std::move(coin), /* possible_overwrite */ false);
+    }
+    const uint256 first_block = InsecureRand256();
+    cache.SetBestBlock(first_block);
+
+    // Syncing hands the coins over to the writer, which answers reads for
+    // them until they are on disk.
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.EvictColdCoins(0), 1000U);
+    BOOST_CHECK(writer.GetBestBlock() == first_block);
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(writer.HaveCoin(outpoint));
+    }
+    BOOST_CHECK(writer.WaitForWrite());
+    BOOST_CHECK(db.GetBestBlock() == first_block);
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(db.HaveCoin(outpoint));
+    }
+
+    // Spentness is written in the background as well.
+    for (size_t i = 0; i < outpoints.size(); i += 2) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    const uint256 second_block = InsecureRand256();
+    cache.SetBestBlock(second_block);
+    BOOST_CHECK(cache.Sync());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        BOOST_CHECK_EQUAL(cache.HaveCoin(outpoints[i]), i % 2 == 1);
+    }
+
+    // A flush waits for the background write and writes in place.
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.GetBestBlock() == cache.GetBestBlock());
+    for (size_t i = 0; i < outpoints.size(); ++i) {
+        BOOST_CHECK_EQUAL(db.HaveCoin(outpoints[i]), i % 2 == 1);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,183 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <index/coinstatsindex.h>
+#include <node/coinstats.h>
+#include <script/standard.h>
+#include <test/util/setup_common.h>
+#include <txdb.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+static void CheckStatsMatchScan(const CoinStatsIndex& index)
+{
+    CCoinsStats index_stats, scan_stats;
+    const CBlockIndex* tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BOOST_REQUIRE(index.LookUpStats(tip, index_stats));
+    BOOST_CHECK(index_stats.from_index);
+
+    ::ChainstateActive().ForceFlushStateToDisk();
+    CCoinsView* coins_view = WITH_LOCK(cs_main, return &::ChainstateActive().CoinsDB());
+    BOOST_REQUIRE(GetUTXOStats(coins_view, scan_stats, CoinStatsHashType::MUHASH));
+    BOOST_CHECK(!scan_stats.from_index);
+
+    BOOST_CHECK_EQUAL(index_stats.nHeight, scan_stats.nHeight);
+    BOOST_CHECK_EQUAL(index_stats.hashBlock, scan_stats.hashBlock);
+    BOOST_CHECK_EQUAL(index_stats.hashSerialized, scan_stats.hashSerialized);
+    BOOST_CHECK_EQUAL(index_stats.nTransactionOutputs, scan_stats.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(index_stats.nBogoSize, scan_stats.nBogoSize);
+    BOOST_CHECK_EQUAL(index_stats.nTotalAmount, scan_stats.nTotalAmount);
+}
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup)
+{
+    CoinStatsIndex coin_stats_index{1 << 20, true};
+
+    CCoinsStats coin_stats;
+    const CBlockIndex* block_index = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+
+    // Stats should not be found in the index before it is started.
+    BOOST_CHECK(!coin_stats_index.LookUpStats(block_index, coin_stats));
+
+    // BlockUntilSyncedToCurrentChain should return false before the index is started.
+    BOOST_CHECK(!coin_stats_index.BlockUntilSyncedToCurrentChain());
+
+    coin_stats_index.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!coin_stats_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        UninterruptibleSleep(std::chrono::milliseconds{100});
+    }
+
+    // The outputs of the genesis block are not in the UTXO set.
+    const CBlockIndex* genesis = WITH_LOCK(cs_main, return ::ChainActive().Genesis());
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(genesis, coin_stats));
+    BOOST_CHECK_EQUAL(coin_stats.nTransactionOutputs, 0U);
+    BOOST_CHECK_EQUAL(coin_stats.nTotalAmount, 0);
+
+    CheckStatsMatchScan(coin_stats_index);
+
+    // Spend a coinbase output into a spendable and an unspendable output, in a new block.
+    const CScript coinbase_script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetHash(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = coinbase_script_pub_key;
+    spend.vout[1].nValue = 0;
+    spend.vout[1].scriptPubKey = CScript() << OP_RETURN;
+    std::vector<unsigned char> sig;
+    const uint256 sighash = SignatureHash(coinbase_script_pub_key, spend, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_REQUIRE(coinbaseKey.Sign(sighash, sig));
+    sig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << sig;
+
+    const CBlock spending_block = CreateAndProcessBlock({spend}, coinbase_script_pub_key);
+    BOOST_REQUIRE_EQUAL(WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash()), spending_block.GetHash());
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    CheckStatsMatchScan(coin_stats_index);
+
+    // Stats of earlier blocks can still be looked up.
+    CCoinsStats earlier_stats;
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(block_index, earlier_stats));
+    BOOST_CHECK_EQUAL(earlier_stats.nHeight, block_index->nHeight);
+    BOOST_CHECK(earlier_stats.hashSerialized != uint256());
+
+    // Reorganize the spending block away. The index takes its outputs out of the
+    // UTXO set again when it learns about the new chain.
+    CCoinsStats spending_stats;
+    CBlockIndex* spending_index = WITH_LOCK(cs_main, return LookupBlockIndex(spending_block.GetHash()));
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(spending_index, spending_stats));
+    BlockValidationState state;
+    BOOST_REQUIRE(InvalidateBlock(state, Params(), spending_index));
+    const CScript other_script_pub_key = GetScriptForDestination(PKHash(coinbaseKey.GetPubKey()));
+    for (int i = 0; i < 2; ++i) {
+        CreateAndProcessBlock({}, other_script_pub_key);
+    }
+    BOOST_CHECK(coin_stats_index.BlockUntilSyncedToCurrentChain());
+    CheckStatsMatchScan(coin_stats_index);
+
+    // The stats of the disconnected block are kept.
+    CCoinsStats disconnected_stats;
+    BOOST_REQUIRE(coin_stats_index.LookUpStats(spending_index, disconnected_stats));
+    BOOST_CHECK_EQUAL(disconnected_stats.hashSerialized, spending_stats.hashSerialized);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    coin_stats_index.Stop();
+
+    // Let scheduler events finish running to avoid accessing any memory related to the index after it is destructed
+    SyncWithValidationInterfaceQueue();
+}
+
+/** A cursor that cannot be cloned, so GetUTXOStats scans the coins serially. */
+class SerialCursor : public CCoinsViewCursor
+{
+    std::unique_ptr<CCoinsViewCursor> m_cursor;
+
+public:
+    explicit SerialCursor(CCoinsViewCursor* cursor) : CCoinsViewCursor(cursor->GetBestBlock()), m_cursor(cursor) {}
+
+    bool GetKey(COutPoint& key) const override { return m_cursor->GetKey(key); }
+    bool GetValue(Coin& coin) const override { return m_cursor->GetValue(coin); }
+    unsigned int GetValueSize() const override { return m_cursor->GetValueSize(); }
+    bool Valid() const override { return m_cursor->Valid(); }
+    void Next() override { m_cursor->Next(); }
+};
+
+class SerialCursorView : public CCoinsViewBacked
+{
+public:
+    using CCoinsViewBacked::CCoinsViewBacked;
+    CCoinsViewCursor* Cursor() const override { return new SerialCursor(base->Cursor()); }
+};
+
+BOOST_FIXTURE_TEST_CASE(coinstats_parallel_scan, TestingSetup)
+{
+    // Coins of many transactions, spread over all ranges the coins are scanned in.
+    CCoinsViewDB coins_db{"coinstats_parallel_scan", 1 << 20, /* fMemory */ true, /* fWipe */ true};
+    {
+        CCoinsViewCache cache{&coins_db};
+        cache.SetBestBlock(Params().GenesisBlock().GetHash());
+        for (int i = 0; i < 5000; ++i) {
+            const uint256 txid = InsecureRand256();
+            const int outputs = 1 + InsecureRandRange(4);
+            for (int n = 0; n < outputs; ++n) {
+                if (InsecureRandBool()) continue;
+                CTxOut out{(CAmount)InsecureRandRange(MAX_MONEY / 10000), CScript() << g_insecure_rand_ctx.randbytes(InsecureRandRange(40))};
+                cache.AddCoin(COutPoint(txid, n), Coin(std::move(out), InsecureRandRange(1000), InsecureRandBool()), /* possible_overwrite */ false);
+            }
+        }
+        BOOST_REQUIRE(cache.Flush());
+    }
+    SerialCursorView serial_view{&coins_db};
+
+    for (CoinStatsHashType hash_type : {CoinStatsHashType::HASH_SERIALIZED, CoinStatsHashType::MUHASH, CoinStatsHashType::NONE}) {
+        CCoinsStats parallel_stats, serial_stats;
+        BOOST_REQUIRE(GetUTXOStats(&coins_db, parallel_stats, hash_type));
+        BOOST_REQUIRE(GetUTXOStats(&serial_view, serial_stats, hash_type));
+
+        BOOST_CHECK(parallel_stats.nTransactionOutputs > 0);
+        BOOST_CHECK_EQUAL(parallel_stats.hashBlock, serial_stats.hashBlock);
+        BOOST_CHECK_EQUAL(parallel_stats.hashSerialized, serial_stats.hashSerialized);
+        BOOST_CHECK_EQUAL(parallel_stats.nTransactions, serial_stats.nTransactions);
+        BOOST_CHECK_EQUAL(parallel_stats.nTransactionOutputs, serial_stats.nTransactionOutputs);
+        BOOST_CHECK_EQUAL(parallel_stats.coins_count, serial_stats.coins_count);
+        BOOST_CHECK_EQUAL(parallel_stats.nBogoSize, serial_stats.nBogoSize);
+        BOOST_CHECK_EQUAL(parallel_stats.nTotalAmount, serial_stats.nTotalAmount);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
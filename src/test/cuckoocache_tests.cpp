@@ -6,6 +6,7 @@
 #include <deque>
 #include <random.h>
 #include <script/sigcache.h>
+#include <set>
 #include <test/util/setup_common.h>
 #include <thread>
 
@@ -363,4 +364,28 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that for_each_live visits exactly the inserted elements that were not
+ * erased.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each_live)
+{
+    SeedInsecureRand(SeedRand::ZEROS);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes;
+    for (int x = 0; x < 1000; ++x) {
+        hashes.push_back(InsecureRand256());
+        cc.insert(hashes.back());
+    }
+    for (int x = 0; x < 500; ++x) {
+        BOOST_CHECK(cc.contains(hashes[x], true));
+    }
+    std::set<uint256> live;
+    cc.for_each_live([&](const uint256& e) { BOOST_CHECK(live.insert(e).second); });
+    BOOST_CHECK_EQUAL(live.size(), 500U);
+    for (int x = 500; x < 1000; ++x) {
+        BOOST_CHECK(live.count(hashes[x]));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END();
@@ -123,4 +123,43 @@ BOOST_AUTO_TEST_CASE(flatfile_flush)
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1U);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_map)
+{
+    const auto data_dir = GetDataDir();
+    FlatFileSeq seq(data_dir, "a", 100);
+
+    // There is nothing to map for a file that does not exist.
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 0)));
+
+    std::string line("A purely peer-to-peer version of electronic cash would allow online "
+                     "payments to be sent directly from one party to another without going "
+                     "through a financial institution.");
+    size_t line_size = GetSerializeSize(line, CLIENT_VERSION);
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line, 256);
+    }
+
+#ifndef WIN32
+    auto mapping = seq.Map(FlatFilePos(0, 0));
+    BOOST_REQUIRE(mapping);
+    BOOST_CHECK_EQUAL(mapping->Data().size(), line_size);
+    BOOST_CHECK_EQUAL(std::string(mapping->Data().begin() + 1, mapping->Data().end()), line);
+
+    // Data appended afterwards is only covered by a new mapping.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, line_size)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line, 256);
+    }
+    BOOST_CHECK_EQUAL(mapping->Data().size(), line_size);
+    auto remapping = seq.Map(FlatFilePos(0, 0));
+    BOOST_REQUIRE(remapping);
+    BOOST_CHECK_EQUAL(remapping->Data().size(), 2 * line_size);
+    BOOST_CHECK(std::equal(mapping->Data().begin(), mapping->Data().end(), remapping->Data().begin()));
+    BOOST_CHECK(std::equal(mapping->Data().begin(), mapping->Data().end(), remapping->Data().begin() + line_size));
+#else
+    BOOST_CHECK(!seq.Map(FlatFilePos(0, 0)));
+#endif
+}
+
 BOOST_AUTO_TEST_SUITE_END()
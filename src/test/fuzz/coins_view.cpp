@@ -50,7 +50,7 @@ void test_one_input(const std::vector<uint8_t>& buffer)
     Coin random_coin;
     CMutableTransaction random_mutable_transaction;
     while (fuzzed_data_provider.ConsumeBool()) {
-        switch (fuzzed_data_provider.ConsumeIntegralInRange<int>(0, 9)) {
+        switch (fuzzed_data_provider.ConsumeIntegralInRange<int>(0, 11)) {
         case 0: {
             if (random_coin.IsSpent()) {
                 break;
@@ -119,7 +119,8 @@ void test_one_input(const std::vector<uint8_t>& buffer)
             break;
         }
         case 9: {
-            CCoinsMap coins_map;
+            CCoinsMapMemoryResource resource;
+            CCoinsMap coins_map{0, SaltedOutpointHasher{}, CCoinsMap::key_equal{}, &resource};
             while (fuzzed_data_provider.ConsumeBool()) {
                 CCoinsCacheEntry coins_cache_entry;
                 coins_cache_entry.flags = fuzzed_data_provider.ConsumeIntegral<unsigned char>();
@@ -146,6 +147,16 @@ void test_one_input(const std::vector<uint8_t>& buffer)
             assert(expected_code_path);
             break;
         }
+        case 10: {
+            (void)coins_view_cache.Sync();
+            break;
+        }
+        case 11: {
+            const size_t cache_size = coins_view_cache.GetCacheSize();
+            const size_t evicted = coins_view_cache.EvictColdCoins(fuzzed_data_provider.ConsumeIntegral<size_t>());
+            assert(coins_view_cache.GetCacheSize() == cache_size - evicted);
+            break;
+        }
         }
     }
 
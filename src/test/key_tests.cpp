@@ -290,6 +290,23 @@ BOOST_AUTO_TEST_CASE(bip340_test_vectors)
         auto sig = ParseHex(test.first[2]);
         BOOST_CHECK_EQUAL(XOnlyPubKey(pubkey).VerifySchnorr(uint256(msg), sig), test.second);
     }
+
+    // The valid signatures verify as a batch, and adding any invalid one makes
+    // the batch fail
+    BatchSchnorrVerifier valid_batch;
+    BOOST_CHECK(valid_batch.Verify());
+    for (const auto& test : VECTORS) {
+        if (!test.second) continue;
+        valid_batch.Add(XOnlyPubKey(ParseHex(test.first[0])), uint256(ParseHex(test.first[1])), ParseHex(test.first[2]));
+    }
+    BOOST_CHECK_EQUAL(valid_batch.size(), 5U);
+    BOOST_CHECK(valid_batch.Verify());
+    for (const auto& test : VECTORS) {
+        if (test.second) continue;
+        BatchSchnorrVerifier batch{valid_batch};
+        batch.Add(XOnlyPubKey(ParseHex(test.first[0])), uint256(ParseHex(test.first[1])), ParseHex(test.first[2]));
+        BOOST_CHECK(!batch.Verify());
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
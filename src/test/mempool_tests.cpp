@@ -2,7 +2,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <consensus/merkle.h>
 #include <policy/policy.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <util/system.h>
 #include <util/time.h>
@@ -788,4 +790,122 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests)
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+/** Check the cached ancestor and descendant state of every entry against a fresh walk of the mempool. */
+static void CheckPackageState(const CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(pool.cs)
+{
+    const uint64_t no_limit = std::numeric_limits<uint64_t>::max();
+    for (CTxMemPool::txiter it = pool.mapTx.begin(); it != pool.mapTx.end(); ++it) {
+        CTxMemPool::setEntries ancestors, descendants;
+        std::string dummy;
+        BOOST_CHECK(pool.CalculateMemPoolAncestors(*it, ancestors, no_limit, no_limit, no_limit, no_limit, dummy, false));
+        ancestors.insert(it);
+        pool.CalculateDescendants(it, descendants);
+
+        uint64_t ancestor_size = 0;
+        CAmount ancestor_fees = 0;
+        int64_t ancestor_sigops = 0;
+        for (CTxMemPool::txiter ancestor : ancestors) {
+            ancestor_size += ancestor->GetTxSize();
+            ancestor_fees += ancestor->GetModifiedFee();
+            ancestor_sigops += ancestor->GetSigOpCost();
+        }
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), ancestors.size());
+        BOOST_CHECK_EQUAL(it->GetSizeWithAncestors(), ancestor_size);
+        BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), ancestor_fees);
+        BOOST_CHECK_EQUAL(it->GetSigOpCostWithAncestors(), ancestor_sigops);
+
+        uint64_t descendant_size = 0;
+        CAmount descendant_fees = 0;
+        for (CTxMemPool::txiter descendant : descendants) {
+            descendant_size += descendant->GetTxSize();
+            descendant_fees += descendant->GetModifiedFee();
+        }
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), descendants.size());
+        BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), descendant_size);
+        BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), descendant_fees);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MempoolRemoveChainTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    // A chain with a branch off its second transaction:
+    //
+    // [chain[0]] <- [chain[1]].0 <- [chain[2]] <- ... <- [chain[9]]
+    //                         .1 <- [branch]
+    std::vector<CTransactionRef> chain;
+    chain.push_back(make_tx(/* output_values */ {10 * COIN, COIN}));
+    for (int i = 1; i < 10; ++i) {
+        chain.push_back(make_tx(/* output_values */ {(10 - i) * COIN, COIN}, /* inputs */ {chain.back()}));
+    }
+    CTransactionRef branch = make_tx(/* output_values */ {COIN / 2}, /* inputs */ {chain[1]}, /* input_indices */ {1});
+    for (size_t i = 0; i < chain.size(); ++i) {
+        pool.addUnchecked(entry.Fee(1000LL * (i + 1)).SigOpsCost(4 * i).FromTx(chain[i]));
+    }
+    pool.addUnchecked(entry.Fee(20000LL).SigOpsCost(4).FromTx(branch));
+    CheckPackageState(pool);
+
+    // Confirming the start of the chain updates all remaining transactions,
+    // including those that descend from it through more than one removed one.
+    pool.removeForBlock({chain[0], chain[1], chain[2]}, 1);
+    BOOST_CHECK_EQUAL(pool.size(), 8U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(chain[9]->GetHash())->GetCountWithAncestors(), 7U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(branch->GetHash())->GetCountWithAncestors(), 1U);
+    CheckPackageState(pool);
+
+    // Removing the end of the chain updates the transactions it descends from.
+    pool.removeRecursive(*chain[6], REMOVAL_REASON_DUMMY);
+    BOOST_CHECK_EQUAL(pool.size(), 4U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(chain[3]->GetHash())->GetCountWithDescendants(), 3U);
+    CheckPackageState(pool);
+
+    // Confirming a single transaction.
+    pool.removeForBlock({chain[3]}, 2);
+    BOOST_CHECK_EQUAL(pool.size(), 3U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(chain[5]->GetHash())->GetCountWithAncestors(), 2U);
+    CheckPackageState(pool);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolShareTransactionsTest)
+{
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+
+    CBlock block;
+    for (int i = 0; i < 10; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint{InsecureRand256(), 0};
+        if (i % 3 == 0) tx.vin[0].scriptWitness.stack.push_back({1, 2, 3});
+        tx.vout.resize(1);
+        tx.vout[0].nValue = COIN;
+        block.vtx.push_back(MakeTransactionRef(tx));
+        if (i % 2 == 0) pool.addUnchecked(entry.FromTx(block.vtx.back()));
+    }
+    const uint256 merkle_root = BlockMerkleRoot(block);
+    const uint256 witness_merkle_root = BlockWitnessMerkleRoot(block);
+
+    // A copy of the block, as received from a peer, gets the transactions
+    // that are in the mempool replaced by the mempool's.
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << block;
+    CBlock received;
+    stream >> received;
+    BOOST_CHECK_EQUAL(pool.ShareTransactions(received.vtx), 5U);
+    for (size_t i = 0; i < block.vtx.size(); ++i) {
+        BOOST_CHECK_EQUAL(received.vtx[i] == block.vtx[i], i % 2 == 0);
+        BOOST_CHECK(received.vtx[i]->GetHash() == block.vtx[i]->GetHash());
+        BOOST_CHECK(received.vtx[i]->GetWitnessHash() == block.vtx[i]->GetWitnessHash());
+    }
+    BOOST_CHECK(BlockMerkleRoot(received) == merkle_root);
+    BOOST_CHECK(BlockWitnessMerkleRoot(received) == witness_merkle_root);
+
+    // Sharing again changes nothing.
+    BOOST_CHECK_EQUAL(pool.ShareTransactions(received.vtx), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -7,8 +7,11 @@
 #include <consensus/consensus.h>
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
+#include <consensus/validation.h>
+#include <crypto/sha256.h>
 #include <miner.h>
 #include <policy/policy.h>
+#include <script/interpreter.h>
 #include <script/standard.h>
 #include <txmempool.h>
 #include <uint256.h>
@@ -515,4 +518,88 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_FIXTURE_TEST_CASE(CreateNewBlock_update, TestChain100Setup)
+{
+    // A BlockAssembler that is used again extends its previous template with
+    // the transactions added to the mempool since, and assembles a new block
+    // once transactions were removed or prioritised.
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const std::vector<unsigned char> op_true{OP_TRUE};
+    uint256 witness_program;
+    CSHA256().Write(op_true.data(), op_true.size()).Finalize(witness_program.begin());
+    const CScript p2wsh_op_true = CScript() << OP_0 << ToByteVector(witness_program);
+
+    const auto ToMemPool = [this](const CMutableTransaction& tx) {
+        LOCK(cs_main);
+
+        TxValidationState state;
+        return AcceptToMemoryPool(*m_node.mempool, state, MakeTransactionRef(tx),
+            nullptr /* plTxnReplaced */, false /* bypass_limits */);
+    };
+    const auto SpendOpTrue = [&](const CMutableTransaction& parent, uint32_t n, CAmount fee) {
+        CMutableTransaction tx;
+        tx.vin.emplace_back(COutPoint{parent.GetHash(), n});
+        tx.vin[0].scriptWitness.stack.push_back(op_true);
+        tx.vout.emplace_back(parent.vout[n].nValue - fee, p2wsh_op_true);
+        return tx;
+    };
+    const auto Txids = [](const CBlockTemplate& block_template) {
+        std::set<uint256> txids;
+        for (size_t i = 1; i < block_template.block.vtx.size(); ++i) {
+            txids.insert(block_template.block.vtx[i]->GetHash());
+        }
+        return txids;
+    };
+
+    BlockAssembler assembler{*m_node.mempool, Params()};
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    BOOST_CHECK(pblocktemplate = assembler.CreateNewBlock(scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+
+    // Split the mature coinbase into two outputs
+    CMutableTransaction parent;
+    parent.vin.emplace_back(COutPoint{m_coinbase_txns[0]->GetHash(), 0});
+    parent.vout.resize(2, CTxOut{m_coinbase_txns[0]->vout[0].nValue / 2 - 5000, p2wsh_op_true});
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, parent, 0, SIGHASH_ALL, 0, SigVersion::BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    parent.vin[0].scriptSig << vchSig;
+    const CAmount parent_fee = m_coinbase_txns[0]->vout[0].nValue - 2 * parent.vout[0].nValue;
+
+    BOOST_CHECK(ToMemPool(parent));
+    BOOST_CHECK(pblocktemplate = assembler.CreateNewBlock(scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+
+    // Transactions were only added: a child of a transaction in the template
+    // and another one are added to it, as a new block would have them
+    const CMutableTransaction child = SpendOpTrue(parent, 0, 20000);
+    const CMutableTransaction other = SpendOpTrue(parent, 1, 30000);
+    BOOST_CHECK(ToMemPool(child));
+    BOOST_CHECK(ToMemPool(other));
+    BOOST_CHECK(pblocktemplate = assembler.CreateNewBlock(scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == parent.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -(parent_fee + 20000 + 30000));
+    BOOST_CHECK(Txids(*pblocktemplate) == Txids(*BlockAssembler{*m_node.mempool, Params()}.CreateNewBlock(scriptPubKey)));
+
+    // After a removal, the removed transaction is gone from the new block
+    WITH_LOCK(m_node.mempool->cs, m_node.mempool->removeRecursive(CTransaction{child}, MemPoolRemovalReason::CONFLICT));
+    BOOST_CHECK(pblocktemplate = assembler.CreateNewBlock(scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -(parent_fee + 30000));
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == other.GetHash());
+
+    // After a prioritisation, the fee deltas are taken into account for the
+    // transactions already in the template as well
+    const CMutableTransaction other_child = SpendOpTrue(other, 0, 10000);
+    BOOST_CHECK(ToMemPool(other_child));
+    BOOST_CHECK(pblocktemplate = assembler.CreateNewBlock(scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+    BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == other_child.GetHash());
+    m_node.mempool->PrioritiseTransaction(other_child.GetHash(), -COIN);
+    BOOST_CHECK(pblocktemplate = assembler.CreateNewBlock(scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,8 @@
 #include <serialize.h>
 #include <span.h>
 #include <streams.h>
+#include <netmessagemaker.h>
+#include <test/util/net.h>
 #include <test/util/setup_common.h>
 #include <util/memory.h>
 #include <util/strencodings.h>
@@ -25,6 +27,10 @@
 #include <memory>
 #include <string>
 
+#ifdef USE_EPOLL
+#include <sys/socket.h>
+#endif
+
 class CAddrManSerializationMock : public CAddrMan
 {
 public:
@@ -769,4 +775,107 @@ BOOST_AUTO_TEST_CASE(PoissonNextSend)
     g_mock_deterministic_tests = false;
 }
 
+BOOST_AUTO_TEST_CASE(socket_events_mode_names)
+{
+    SocketEventsMode mode = SocketEventsMode::SELECT;
+    BOOST_CHECK(SocketEventsModeByName(SocketEventsModeName(DEFAULT_SOCKET_EVENTS_MODE), mode));
+    BOOST_CHECK(mode == DEFAULT_SOCKET_EVENTS_MODE);
+    BOOST_CHECK(!SocketEventsModeByName("", mode));
+    BOOST_CHECK(!SocketEventsModeByName("kqueue", mode));
+#ifdef USE_EPOLL
+    BOOST_CHECK(SocketEventsModeByName("epoll", mode));
+    BOOST_CHECK(mode == SocketEventsMode::EPOLL);
+    BOOST_CHECK(ListSocketEventsModes().find("epoll") != std::string::npos);
+#endif
+}
+
+#ifdef USE_EPOLL
+static void CheckSocketHandlerReceive(SocketEventsMode mode)
+{
+    ConnmanTestMsg connman{0x1337, 0x1337};
+    CConnman::Options options;
+    options.m_socket_events_mode = mode;
+    options.nReceiveFloodSize = 1000 * DEFAULT_MAXRECEIVEBUFFER;
+    connman.Init(options);
+
+    int sockets[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    CNode* node = new CNode(0, NODE_NETWORK, 0, sockets[0], CAddress{}, 0, 0, CAddress{}, std::string{}, ConnectionType::INBOUND);
+    connman.AddTestNode(*node);
+
+    // A message larger than the receive buffer takes more than one read, and
+    // with edge-triggered epoll the rest of it is not reported again.
+    CSerializedNetMsg msg = CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::PING, std::vector<unsigned char>(100000));
+    std::vector<unsigned char> header;
+    node->m_serializer->prepareForTransport(msg, header);
+    BOOST_REQUIRE(send(sockets[1], header.data(), header.size(), 0) == (ssize_t)header.size());
+    BOOST_REQUIRE(send(sockets[1], msg.data.data(), msg.data.size(), 0) == (ssize_t)msg.data.size());
+
+    for (int i = 0; i < 4; ++i) {
+        connman.SocketHandlerOnce();
+    }
+    {
+        LOCK(node->cs_vProcessMsg);
+        BOOST_CHECK_EQUAL(node->vProcessMsg.size(), 1U);
+        BOOST_CHECK_EQUAL(node->nProcessQueueSize, header.size() + msg.data.size());
+    }
+    BOOST_CHECK(!node->fDisconnect);
+
+    // The peer going away is noticed as well.
+    close(sockets[1]);
+    connman.SocketHandlerOnce();
+    BOOST_CHECK(node->fDisconnect);
+
+    connman.ClearTestNodes();
+}
+
+BOOST_AUTO_TEST_CASE(socket_handler_receive)
+{
+    CheckSocketHandlerReceive(DEFAULT_SOCKET_EVENTS_MODE);
+    CheckSocketHandlerReceive(SocketEventsMode::EPOLL);
+}
+
+BOOST_AUTO_TEST_CASE(push_message_external_payload)
+{
+    ConnmanTestMsg connman{0x1337, 0x1337};
+    connman.Init(CConnman::Options{});
+
+    int sockets[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+    CNode* node = new CNode(0, NODE_NETWORK, 0, sockets[0], CAddress{}, 0, 0, CAddress{}, std::string{}, ConnectionType::INBOUND);
+    connman.AddTestNode(*node);
+
+    // Larger than the socket buffer, so that it cannot be sent at once.
+    auto payload = std::make_shared<std::vector<unsigned char>>(4000000);
+    for (size_t i = 0; i < payload->size(); ++i) {
+        (*payload)[i] = i % 251;
+    }
+    CSerializedNetMsg msg = CNetMsgMaker(INIT_PROTO_VERSION).MakeExternal(NetMsgType::BLOCK, payload, MakeSpan(*payload));
+    BOOST_CHECK(msg.data.empty());
+    std::vector<unsigned char> expected;
+    node->m_serializer->prepareForTransport(msg, expected);
+    expected.insert(expected.end(), payload->begin(), payload->end());
+
+    // The send queue refers to the payload instead of holding a copy of it.
+    connman.PushMessage(node, std::move(msg));
+    BOOST_CHECK_EQUAL(payload.use_count(), 2);
+
+    std::vector<unsigned char> received;
+    std::vector<unsigned char> buf(65536);
+    for (int i = 0; i < 1000 && received.size() < expected.size(); ++i) {
+        ssize_t n = recv(sockets[1], buf.data(), buf.size(), MSG_DONTWAIT);
+        if (n > 0) {
+            received.insert(received.end(), buf.begin(), buf.begin() + n);
+        }
+        connman.SocketHandlerOnce();
+    }
+    BOOST_CHECK(received == expected);
+    BOOST_CHECK(WITH_LOCK(node->cs_vSend, return node->vSendMsg.empty()));
+    BOOST_CHECK_EQUAL(payload.use_count(), 1);
+
+    connman.ClearTestNodes();
+    close(sockets[1]);
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,120 @@
+// Copyright (c) 2021 The Rwa Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <memusage.h>
+#include <support/allocators/pool.h>
+#include <test/util/setup_common.h>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pool_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(basic_allocating)
+{
+    PoolResource<8, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024U);
+
+    // Blocks of up to 8 bytes come from the chunk, one after the other.
+    void* block = resource.Allocate(8, 8);
+    void* next = resource.Allocate(1, 1);
+    BOOST_CHECK_EQUAL(static_cast<char*>(next) - static_cast<char*>(block), 8);
+
+    // A deallocated block is the next one handed out for its size.
+    resource.Deallocate(block, 8, 8);
+    BOOST_CHECK_EQUAL(resource.FreeListBytes(), 8U);
+    BOOST_CHECK_EQUAL(resource.Allocate(7, 4), block);
+    BOOST_CHECK_EQUAL(resource.FreeListBytes(), 0U);
+
+    // Too large or too strictly aligned blocks bypass the pool.
+    void* large = resource.Allocate(16, 8);
+    resource.Deallocate(large, 16, 8);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1U);
+
+    // Only a full chunk makes the pool take a new one.
+    for (size_t i = 0; i < 1024 / 8; ++i) {
+        resource.Allocate(8, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(free_lists_per_size)
+{
+    PoolResource<32, 8> resource(256);
+    void* small = resource.Allocate(8, 8);
+    void* large = resource.Allocate(32, 8);
+    resource.Deallocate(small, 8, 8);
+    resource.Deallocate(large, 32, 8);
+
+    // Freed blocks are only reused for the same (rounded) size.
+    BOOST_CHECK_EQUAL(resource.Allocate(25, 8), large);
+    BOOST_CHECK_EQUAL(resource.Allocate(3, 2), small);
+}
+
+BOOST_AUTO_TEST_CASE(unordered_map_with_pool)
+{
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<uint64_t>,
+                               PoolAllocator<std::pair<const uint64_t, uint64_t>, 64, alignof(void*)>>
+        Map;
+    Map::allocator_type::ResourceType resource(1024);
+    {
+        Map map{0, Map::hasher{}, Map::key_equal{}, &resource};
+        for (uint64_t i = 0; i < 1000; ++i) {
+            map[i] = i * 2;
+        }
+        const size_t full_usage = memusage::DynamicUsage(map);
+        const size_t full_free_list_bytes = resource.FreeListBytes();
+        for (uint64_t i = 0; i < 1000; i += 2) {
+            map.erase(i);
+        }
+        BOOST_CHECK_EQUAL(map.size(), 500U);
+        for (uint64_t i = 1; i < 1000; i += 2) {
+            BOOST_CHECK_EQUAL(map.at(i), i * 2);
+        }
+
+        // The memory usage is made of the pool's chunks and the bucket array,
+        // less the erased nodes waiting in the free lists.
+        const size_t chunks = resource.NumAllocatedChunks();
+        BOOST_CHECK_GT(chunks, 1U);
+        const size_t erased_bytes = resource.FreeListBytes() - full_free_list_bytes;
+        BOOST_CHECK_GE(erased_bytes, 500 * sizeof(Map::value_type));
+        BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), full_usage - erased_bytes);
+
+        // Erased nodes are reused before the pool grows again.
+        for (uint64_t i = 0; i < 1000; i += 2) {
+            map[i] = i;
+        }
+        BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+        BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), full_usage);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_releases_pool_on_flush)
+{
+    CCoinsView base;
+    CCoinsViewCache backing(&base);
+    CCoinsViewCache cache(&backing);
+    const size_t empty_usage = cache.DynamicMemoryUsage();
+
+    Coin coin;
+    coin.out.nValue = 1;
+    coin.out.scriptPubKey.assign(25U, uint8_t{0x51});
+    for (uint32_t n = 0; n < 100000; ++n) {
+        cache.AddCoin(COutPoint{InsecureRand256(), n}, Coin(coin), /* possible_overwrite */ false);
+    }
+    BOOST_CHECK_GT(cache.DynamicMemoryUsage(), empty_usage);
+
+    // Flushing moves the coins to the parent and gives the chunks back.
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK_EQUAL(cache.DynamicMemoryUsage(), empty_usage);
+    BOOST_CHECK_EQUAL(backing.GetCacheSize(), 100000U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -859,4 +859,33 @@ BOOST_AUTO_TEST_CASE(test_IsStandard)
     fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 }
 
+BOOST_AUTO_TEST_CASE(hash_transactions)
+{
+    std::vector<CMutableTransaction> mtxs;
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < 20; ++i) {
+        CMutableTransaction mtx;
+        mtx.vin.resize(1 + InsecureRandRange(3));
+        for (CTxIn& in : mtx.vin) {
+            in.prevout = COutPoint{InsecureRand256(), 0};
+            in.scriptSig.assign(InsecureRandRange(200), OP_1);
+            if (InsecureRandBool()) in.scriptWitness.stack.push_back(std::vector<unsigned char>(InsecureRandRange(100), 1));
+        }
+        mtx.vout.resize(1);
+        mtxs.push_back(mtx);
+        txs.push_back(MakeTransactionRef(mtx));
+        // Some of the transactions already know their hashes.
+        if (i % 4 == 0) txs.back()->GetHash();
+    }
+
+    HashTransactions(txs);
+    for (size_t i = 0; i < txs.size(); ++i) {
+        BOOST_CHECK(txs[i]->GetHash() == mtxs[i].GetHash());
+        BOOST_CHECK(txs[i]->GetWitnessHash() == (mtxs[i].HasWitness() ? SerializeHash(mtxs[i], SER_GETHASH, 0) : mtxs[i].GetHash()));
+        const CTransaction copy{*txs[i]};
+        BOOST_CHECK(copy.GetWitnessHash() == txs[i]->GetWitnessHash());
+    }
+    BOOST_CHECK(CTransaction{}.GetHash().IsNull());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
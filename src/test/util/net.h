@@ -11,6 +11,7 @@ struct ConnmanTestMsg : public CConnman {
     using CConnman::CConnman;
     void AddTestNode(CNode& node)
     {
+        RegisterSocketEvents(&node);
         LOCK(cs_vNodes);
         vNodes.push_back(&node);
     }
@@ -21,10 +22,13 @@ struct ConnmanTestMsg : public CConnman {
             delete node;
         }
         vNodes.clear();
+        m_recv_pending.clear();
     }
 
     void ProcessMessagesOnce(CNode& node) { m_msgproc->ProcessMessages(&node, flagInterruptMsgProc); }
 
+    void SocketHandlerOnce() { SocketHandler(); }
+
     void NodeReceiveMsgBytes(CNode& node, const char* pch, unsigned int nBytes, bool& complete) const;
 
     bool ReceiveMsgFrom(CNode& node, CSerializedNetMsg& ser_msg) const;
@@ -167,6 +167,16 @@ TestingSetup::TestingSetup(const std::string& chainName, const std::vector<const
     }
     g_parallel_script_checks = true;
 
+    // Start input-prefetch threads. Set g_parallel_input_fetch to true so they are used.
+    constexpr int input_fetch_threads = 2;
+    for (int i = 0; i < input_fetch_threads; ++i) {
+        threadGroup.create_thread([i]() { return ThreadInputFetch(i); });
+    }
+    g_parallel_input_fetch = true;
+
+    // Start the block read-ahead thread.
+    threadGroup.create_thread(&ThreadBlockReadAhead);
+
     m_node.banman = MakeUnique<BanMan>(GetDataDir() / "banlist.dat", nullptr, DEFAULT_MISBEHAVING_BANTIME);
     m_node.connman = MakeUnique<CConnman>(0x1337, 0x1337); // Deterministic randomness for tests.
     m_node.peerman = MakeUnique<PeerManager>(chainparams, *m_node.connman, m_node.banman.get(), *m_node.scheduler, *m_node.chainman, *m_node.mempool);
@@ -195,10 +205,18 @@ TestingSetup::~TestingSetup()
     pblocktree.reset();
 }
 
-TestChain100Setup::TestChain100Setup()
+TestChain100Setup::TestChain100Setup(bool deterministic)
 {
+    if (deterministic) {
+        // Any time after the regtest genesis block works.
+        SetMockTime(1742130000);
+        const std::vector<unsigned char> vchKey(ParseHex("0000000000000000000000000000000000000000000000000000000000000001"));
+        coinbaseKey.Set(vchKey.begin(), vchKey.end(), true);
+    } else {
+        coinbaseKey.MakeNewKey(true);
+    }
+
     // Generate a 100-block chain:
-    coinbaseKey.MakeNewKey(true);
     CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
     for (int i = 0; i < COINBASE_MATURITY; i++) {
         std::vector<CMutableTransaction> noTxns;
@@ -230,6 +248,7 @@ CBlock TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransa
 TestChain100Setup::~TestChain100Setup()
 {
     gArgs.ForceSetArg("-segwitheight", "0");
+    SetMockTime(0);
 }
 
 CTxMemPoolEntry TestMemPoolEntryHelper::FromTx(const CMutableTransaction& tx)
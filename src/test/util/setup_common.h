@@ -107,7 +107,12 @@ class CScript;
  * Testing fixture that pre-creates a 100-block REGTEST-mode block chain
  */
 struct TestChain100Setup : public RegTestingSetup {
-    TestChain100Setup();
+    /**
+     * @param[in] deterministic  Use a fixed coinbase key and mock time, so that
+     *                           the chain (and its UTXO set) is the same on
+     *                           every run.
+     */
+    explicit TestChain100Setup(bool deterministic = false);
 
     /**
      * Create a new block with just given transactions, coinbase paying to
@@ -122,6 +127,14 @@ struct TestChain100Setup : public RegTestingSetup {
     CKey coinbaseKey; // private/public key needed to spend coinbase transactions
 };
 
+/**
+ * Like TestChain100Setup, but the chain is the same on every run, for tests
+ * that compare against hardcoded block or UTXO set hashes.
+ */
+struct TestChain100DeterministicSetup : public TestChain100Setup {
+    TestChain100DeterministicSetup() : TestChain100Setup(true) { }
+};
+
 class CTxMemPoolEntry;
 
 struct TestMemPoolEntryHelper
@@ -4,10 +4,15 @@
 //
 #include <chainparams.h>
 #include <consensus/validation.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
 #include <random.h>
+#include <streams.h>
 #include <sync.h>
 #include <test/util/setup_common.h>
+#include <txdb.h>
 #include <uint256.h>
+#include <util/system.h>
 #include <validation.h>
 #include <validationinterface.h>
 
@@ -151,4 +156,119 @@ BOOST_AUTO_TEST_CASE(chainstatemanager_rebalance_caches)
     BOOST_CHECK_CLOSE(c2.m_coinsdb_cache_size_bytes, max_cache * 0.95, 1);
 }
 
+//! Write the UTXO set of the active chainstate the way dumptxoutset does,
+//! optionally with a wrong coins count or a tampered coin.
+static fs::path WriteSnapshot(const std::string& name, int coins_count_offset = 0, bool tamper = false)
+{
+    const fs::path path = GetDataDir() / name;
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    CCoinsStats stats;
+    const CBlockIndex* tip;
+    {
+        LOCK(::cs_main);
+        ::ChainstateActive().ForceFlushStateToDisk();
+        BOOST_REQUIRE(GetUTXOStats(&::ChainstateActive().CoinsDB(), stats, CoinStatsHashType::NONE, [] {}));
+        pcursor.reset(::ChainstateActive().CoinsDB().Cursor());
+        tip = LookupBlockIndex(stats.hashBlock);
+    }
+
+    CAutoFile afile{fsbridge::fopen(path, "wb"), SER_DISK, CLIENT_VERSION};
+    afile << SnapshotMetadata{tip->GetBlockHash(), stats.coins_count + coins_count_offset, tip->nChainTx};
+    COutPoint key;
+    Coin coin;
+    while (pcursor->Valid()) {
+        BOOST_REQUIRE(pcursor->GetKey(key) && pcursor->GetValue(coin));
+        if (tamper) {
+            coin.out.nValue += 1;
+            tamper = false;
+        }
+        afile << key;
+        afile << coin;
+        pcursor->Next();
+    }
+    return path;
+}
+
+static bool LoadSnapshot(ChainstateManager& chainman, const fs::path& path)
+{
+    CAutoFile afile{fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION};
+    SnapshotMetadata metadata;
+    afile >> metadata;
+    return chainman.ActivateSnapshot(afile, metadata, /* in_memory */ true);
+}
+
+//! Load a snapshot of the regtest chain at the assumeutxo height on top of a
+//! shorter active chain, then let the background chainstate catch up with
+//! and validate it.
+BOOST_FIXTURE_TEST_CASE(chainstatemanager_activate_snapshot, TestChain100DeterministicSetup)
+{
+    ChainstateManager& chainman = *Assert(m_node.chainman);
+    const CChainParams& chainparams = Params();
+    const CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    // Mine up to the height of the regtest assumeutxo parameters.
+    for (int i = 0; i < 10; ++i) {
+        CreateAndProcessBlock({}, script_pub_key);
+    }
+    BOOST_REQUIRE_EQUAL(chainman.ActiveHeight(), 110);
+    const AssumeutxoData* au_data = ExpectedAssumeutxo(110, chainparams);
+    BOOST_REQUIRE(au_data);
+    BOOST_CHECK(!ExpectedAssumeutxo(109, chainparams));
+
+    CCoinsStats stats;
+    CCoinsViewDB* coins_db;
+    {
+        LOCK(::cs_main);
+        ::ChainstateActive().ForceFlushStateToDisk();
+        coins_db = &::ChainstateActive().CoinsDB();
+    }
+    BOOST_REQUIRE(GetUTXOStats(coins_db, stats, CoinStatsHashType::HASH_SERIALIZED, [] {}));
+    BOOST_CHECK_EQUAL(stats.hashSerialized, au_data->hash_serialized);
+    BOOST_CHECK_EQUAL(chainman.ActiveTip()->nChainTx, au_data->nChainTx);
+
+    const fs::path good = WriteSnapshot("snapshot.dat");
+    const fs::path too_many = WriteSnapshot("too_many.dat", +1);
+    const fs::path too_few = WriteSnapshot("too_few.dat", -1);
+    const fs::path tampered = WriteSnapshot("tampered.dat", 0, /* tamper */ true);
+
+    // A snapshot can't be loaded at or below the active tip.
+    BOOST_CHECK(!LoadSnapshot(chainman, good));
+
+    // Roll the active chain back to height 105 without forgetting the blocks
+    // above it, so they are there for the background chainstate.
+    CBlockIndex* base = chainman.ActiveTip();
+    {
+        BlockValidationState state;
+        BOOST_REQUIRE(InvalidateBlock(state, chainparams, base->GetAncestor(106)));
+        LOCK(::cs_main);
+        BOOST_REQUIRE_EQUAL(chainman.ActiveHeight(), 105);
+        ::ChainstateActive().ResetBlockFailureFlags(base->GetAncestor(106));
+    }
+
+    BOOST_CHECK(!LoadSnapshot(chainman, too_many));
+    BOOST_CHECK(!LoadSnapshot(chainman, too_few));
+    BOOST_CHECK(!LoadSnapshot(chainman, tampered));
+    BOOST_CHECK(!chainman.IsSnapshotActive());
+    BOOST_CHECK_EQUAL(chainman.ActiveHeight(), 105);
+
+    BOOST_REQUIRE(LoadSnapshot(chainman, good));
+    BOOST_CHECK(chainman.IsSnapshotActive());
+    BOOST_CHECK(!chainman.IsSnapshotValidated());
+    BOOST_CHECK_EQUAL(chainman.ActiveTip(), base);
+    BOOST_CHECK_EQUAL(chainman.ValidatedTip()->nHeight, 105);
+    BOOST_CHECK_EQUAL(WITH_LOCK(::cs_main, return chainman.ActiveChainstate().CoinsTip().GetBestBlock()), base->GetBlockHash());
+
+    // Only one snapshot can be active.
+    BOOST_CHECK(!LoadSnapshot(chainman, good));
+
+    // New blocks extend the snapshot chainstate, and the background
+    // chainstate connects the blocks up to the snapshot base.
+    CreateAndProcessBlock({}, script_pub_key);
+    BOOST_CHECK_EQUAL(chainman.ActiveHeight(), 111);
+    BOOST_CHECK(chainman.IsSnapshotValidated());
+    BOOST_CHECK_EQUAL(chainman.ValidatedTip(), chainman.ActiveTip());
+
+    SyncWithValidationInterfaceQueue();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 
 #include <txdb.h>
 
+#include <logging/timer.h>
 #include <node/ui_interface.h>
 #include <pow.h>
 #include <random.h>
@@ -17,6 +18,9 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <functional>
+
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
@@ -47,11 +51,15 @@ CCoinsViewDB::CCoinsViewDB(fs::path ldb_path, size_t nCacheSize, bool fMemory, b
 
 void CCoinsViewDB::ResizeCache(size_t new_cache_size)
 {
-    // Have to do a reset first to get the original `m_db` state to release its
-    // filesystem lock.
-    m_db.reset();
-    m_db = MakeUnique<CDBWrapper>(
-        m_ldb_path, new_cache_size, m_is_memory, /*fWipe*/ false, /*obfuscate*/ true);
+    // We can't do this operation with an in-memory DB since we'll lose all the coins upon
+    // reset.
+    if (!m_is_memory) {
+        // Have to do a reset first to get the original `m_db` state to release its
+        // filesystem lock.
+        m_db.reset();
+        m_db = MakeUnique<CDBWrapper>(
+            m_ldb_path, new_cache_size, m_is_memory, /*fWipe*/ false, /*obfuscate*/ true);
+    }
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
@@ -77,7 +85,53 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+void CCoinsViewDB::StartBulkLoad()
+{
+    LogPrintf("Writing the coin database in bulk load mode\n");
+    m_bulk_load = true;
+}
+
+void CCoinsViewDB::FinishBulkLoad()
+{
+    if (!m_bulk_load.exchange(false)) return;
+    LOG_TIME_SECONDS("compact coin database after bulk load");
+    m_db->CompactRange(DB_COIN, (char)(DB_COIN+1));
+}
+
+/** Minimum number of coins sorted by one thread in bulk load mode. */
+static constexpr size_t MIN_COINS_PER_SORT_THREAD{1 << 16};
+
+/**
+ * Sort the entries by outpoint, which is the order of their keys in the
+ * database. Slices of the entries are sorted on separate threads and then
+ * merged.
+ */
+static void SortByOutpoint(std::vector<const CCoinsMap::value_type*>& entries)
+{
+    const auto less = [](const CCoinsMap::value_type* a, const CCoinsMap::value_type* b) { return a->first < b->first; };
+    const size_t num_slices = std::max<size_t>(1, std::min<size_t>(GetNumCores(), entries.size() / MIN_COINS_PER_SORT_THREAD));
+    std::vector<std::vector<const CCoinsMap::value_type*>::iterator> bounds;
+    for (size_t i = 0; i <= num_slices; ++i) {
+        bounds.push_back(entries.begin() + entries.size() * i / num_slices);
+    }
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_slices; ++i) {
+        threads.emplace_back([&bounds, &less, i] { std::sort(bounds[i], bounds[i + 1], less); });
+    }
+    std::sort(bounds[0], bounds[1], less);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    for (size_t width = 1; width < num_slices; width *= 2) {
+        for (size_t i = 0; i + width < num_slices; i += 2 * width) {
+            std::inplace_merge(bounds[i], bounds[i + width], bounds[std::min(i + 2 * width, num_slices)], less);
+        }
+    }
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase) {
     CDBBatch batch(*m_db);
     size_t count = 0;
     size_t changed = 0;
@@ -102,18 +156,14 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, Vector(hashBlock, old_tip));
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            CoinEntry entry(&it->first);
-            if (it->second.coin.IsSpent())
-                batch.Erase(entry);
-            else
-                batch.Write(entry, it->second.coin);
-            changed++;
-        }
-        count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+    // Add a modified coin to the batch, and write the batch out once it is full.
+    const auto write_coin = [&](const COutPoint& outpoint, const Coin& coin) {
+        CoinEntry entry(&outpoint);
+        if (coin.IsSpent())
+            batch.Erase(entry);
+        else
+            batch.Write(entry, coin);
+        changed++;
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             m_db->WriteBatch(batch);
@@ -126,6 +176,29 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
                 }
             }
         }
+    };
+
+    if (m_bulk_load) {
+        std::vector<const CCoinsMap::value_type*> modified;
+        for (const auto& entry : mapCoins) {
+            if (entry.second.flags & CCoinsCacheEntry::DIRTY) {
+                modified.push_back(&entry);
+            }
+        }
+        SortByOutpoint(modified);
+        for (const CCoinsMap::value_type* entry : modified) {
+            write_coin(entry->first, entry->second.coin);
+        }
+        count = mapCoins.size();
+        if (erase) mapCoins.clear();
+    } else {
+        for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+            if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                write_coin(it->first, it->second.coin);
+            }
+            count++;
+            it = erase ? mapCoins.erase(it) : std::next(it);
+        }
     }
 
     // In the last batch, mark the database as consistent with hashBlock again.
@@ -143,6 +216,133 @@ size_t CCoinsViewDB::EstimateSize() const
     return m_db->EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
+CCoinsViewAsyncWriter::CCoinsViewAsyncWriter(CCoinsView* view) : CCoinsViewBacked(view)
+{
+    m_thread = std::thread(&TraceThread<std::function<void()>>, "coinswriter", std::bind(&CCoinsViewAsyncWriter::ThreadWrite, this));
+}
+
+CCoinsViewAsyncWriter::~CCoinsViewAsyncWriter()
+{
+    WaitForWrite();
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+}
+
+void CCoinsViewAsyncWriter::ThreadWrite()
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (true) {
+        m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || (m_pending && !m_write_failed); });
+        if (m_stop) return;
+
+        // The batch is not modified until it is reset below, so it can be
+        // read without the lock, concurrently with GetCoin().
+        CCoinsMap& batch = *m_pending;
+        const uint256 hash_block = m_pending_block;
+        bool written = false;
+        {
+            REVERSE_LOCK(lock);
+            LOG_TIME_MILLIS_WITH_CATEGORY(strprintf("write %u coins to disk in the background", batch.size()), BCLog::BENCH);
+            try {
+                written = base->BatchWrite(batch, hash_block, /* erase */ false);
+            } catch (const std::runtime_error& e) {
+                LogPrintf("Error writing to the coin database: %s\n", e.what());
+            }
+        }
+        if (written) {
+            m_pending.reset();
+            m_pending_resource.reset();
+        } else {
+            m_write_failed = true;
+        }
+        m_cv.notify_all();
+    }
+}
+
+bool CCoinsViewAsyncWriter::WaitForWrite() const
+{
+    WAIT_LOCK(m_mutex, lock);
+    m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return !m_pending || m_write_failed; });
+    return !m_write_failed;
+}
+
+bool CCoinsViewAsyncWriter::GetCoin(const COutPoint &outpoint, Coin &coin) const
+{
+    {
+        LOCK(m_mutex);
+        if (m_pending) {
+            CCoinsMap::const_iterator it = m_pending->find(outpoint);
+            if (it != m_pending->end()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
+    // Coins not in the batch are not touched by writing it. A new batch can
+    // only be handed over by the thread owning the cache above, which is not
+    // reading concurrently.
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewAsyncWriter::HaveCoin(const COutPoint &outpoint) const
+{
+    {
+        LOCK(m_mutex);
+        if (m_pending) {
+            CCoinsMap::const_iterator it = m_pending->find(outpoint);
+            if (it != m_pending->end()) {
+                return !it->second.coin.IsSpent();
+            }
+        }
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewAsyncWriter::GetBestBlock() const
+{
+    {
+        LOCK(m_mutex);
+        if (m_pending) return m_pending_block;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewAsyncWriter::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase)
+{
+    if (!WaitForWrite()) return false;
+    if (erase) {
+        // The caller drops its entries, so write them right away.
+        return base->BatchWrite(mapCoins, hashBlock, erase);
+    }
+
+    auto resource = MakeUnique<CCoinsMapMemoryResource>();
+    auto batch = MakeUnique<CCoinsMap>(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), resource.get());
+    for (const auto& entry : mapCoins) {
+        if (entry.second.flags & CCoinsCacheEntry::DIRTY) {
+            batch->emplace(entry);
+        }
+    }
+    {
+        LOCK(m_mutex);
+        m_pending_resource = std::move(resource);
+        m_pending = std::move(batch);
+        m_pending_block = hashBlock;
+    }
+    m_cv.notify_all();
+    return true;
+}
+
+CCoinsViewCursor *CCoinsViewAsyncWriter::Cursor() const
+{
+    // The cursor iterates over the database, so the batch has to be in it.
+    WaitForWrite();
+    return base->Cursor();
+}
+
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
 }
 
@@ -167,19 +367,23 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(*m_db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COIN);
-    // Cache key of first record
-    if (i->pcursor->Valid()) {
-        CoinEntry entry(&i->keyTmp.second);
-        i->pcursor->GetKey(entry);
-        i->keyTmp.first = entry.key;
-    } else {
-        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+    CDBWrapper& db = const_cast<CDBWrapper&>(*m_db);
+    // Iterate over a snapshot, so the coins match the best block, and clones
+    // of the cursor see the same coins.
+    CDBWrapper::Snapshot snapshot = db.GetSnapshot();
+    uint256 hashBestChain;
+    {
+        std::unique_ptr<CDBIterator> it(db.NewIterator(snapshot));
+        it->Seek(DB_BEST_BLOCK);
+        char key;
+        if (it->Valid() && it->GetKey(key) && key == DB_BEST_BLOCK) it->GetValue(hashBestChain);
     }
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(db, std::move(snapshot), hashBestChain);
+    i->pcursor->Seek(DB_COIN);
+    i->CacheKey();
     return i;
 }
 
@@ -211,6 +415,11 @@ bool CCoinsViewDBCursor::Valid() const
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
+    CacheKey();
+}
+
+void CCoinsViewDBCursor::CacheKey()
+{
     CoinEntry entry(&keyTmp.second);
     if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
@@ -219,6 +428,21 @@ void CCoinsViewDBCursor::Next()
     }
 }
 
+CCoinsViewCursor* CCoinsViewDBCursor::Clone() const
+{
+    CCoinsViewDBCursor* i = new CCoinsViewDBCursor(m_db, m_snapshot, GetBestBlock());
+    i->pcursor->Seek(DB_COIN);
+    i->CacheKey();
+    return i;
+}
+
+void CCoinsViewDBCursor::Seek(const uint256& txid)
+{
+    const COutPoint first(txid, 0);
+    pcursor->Seek(CoinEntry(&first));
+    CacheKey();
+}
+
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
     CDBBatch batch(*this);
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
@@ -243,43 +467,84 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+//! Number of block index entries read from the database before they are hashed and linked.
+static constexpr size_t BLOCK_INDEX_LOAD_BATCH{1 << 14};
+static constexpr size_t MIN_ENTRIES_PER_HASH_THREAD{1 << 11};
+
+/** Compute the block hashes of the entries, splitting the work over several threads. */
+static void HashBlockIndexEntries(const std::vector<CDiskBlockIndex>& entries, std::vector<uint256>& hashes)
+{
+    hashes.resize(entries.size());
+    const size_t num_slices = std::max<size_t>(1, std::min<size_t>(GetNumCores(), entries.size() / MIN_ENTRIES_PER_HASH_THREAD));
+    const auto hash_slice = [&entries, &hashes, num_slices](size_t slice) {
+        for (size_t i = entries.size() * slice / num_slices; i < entries.size() * (slice + 1) / num_slices; ++i) {
+            hashes[i] = entries[i].GetBlockHash();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_slices; ++i) {
+        threads.emplace_back(hash_slice, i);
+    }
+    hash_slice(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
-    // Load m_block_index
-    while (pcursor->Valid()) {
-        if (ShutdownRequested()) return false;
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
+    // Load m_block_index. Reading the database is sequential, but most of the
+    // time goes into hashing the block headers, so the entries are read in
+    // batches whose hashes are computed in parallel before they are linked.
+    std::vector<CDiskBlockIndex> entries;
+    std::vector<uint256> hashes;
+    entries.reserve(BLOCK_INDEX_LOAD_BATCH);
+    bool done = false;
+    while (!done) {
+        entries.clear();
+        while (entries.size() < BLOCK_INDEX_LOAD_BATCH) {
+            if (!pcursor->Valid()) {
+                done = true;
+                break;
+            }
+            if (ShutdownRequested()) return false;
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+                done = true;
+                break;
+            }
+            entries.emplace_back();
+            if (!pcursor->GetValue(entries.back())) {
                 return error("%s: failed to read value", __func__);
             }
-        } else {
-            break;
+            pcursor->Next();
+        }
+
+        HashBlockIndexEntries(entries, hashes);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            const CDiskBlockIndex& diskindex = entries[i];
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(hashes[i]);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+
+            if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
+                return error("%s: CheckProofOfWork failed: %s", __func__, pindexNew->ToString());
         }
     }
 
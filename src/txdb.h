@@ -10,9 +10,13 @@
 #include <dbwrapper.h>
 #include <chain.h>
 #include <primitives/block.h>
+#include <sync.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -49,6 +53,8 @@ protected:
     std::unique_ptr<CDBWrapper> m_db;
     fs::path m_ldb_path;
     bool m_is_memory;
+    //! Whether the coins are written in key order, see StartBulkLoad()
+    std::atomic<bool> m_bulk_load{false};
 public:
     /**
      * @param[in] ldb_path    Location in the filesystem where leveldb data will be stored.
@@ -59,7 +65,7 @@ public:
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
-    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
     CCoinsViewCursor *Cursor() const override;
 
     //! Attempt to update from an older database format. Returns whether an error occurred.
@@ -68,6 +74,68 @@ public:
 
     //! Dynamically alter the underlying leveldb cache size.
     void ResizeCache(size_t new_cache_size) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    /**
+     * Start filling the database from scratch (-reindex, -reindex-chainstate).
+     * Until FinishBulkLoad(), every BatchWrite sorts the modified coins by
+     * key, on several threads, before writing them. Leveldb then flushes
+     * tables with disjoint key ranges, which its compactions can mostly move
+     * down a level instead of rewriting, where tables made from coins in hash
+     * table order each overlap the whole database.
+     */
+    void StartBulkLoad();
+
+    //! Write the coins in hash table order again, and compact the coins once.
+    void FinishBulkLoad();
+};
+
+/**
+ * CCoinsView that writes to the view below it (the coin database) on a
+ * background thread.
+ *
+ * A BatchWrite that keeps the caller's entries (erase == false, see
+ * CCoinsViewCache::Sync) only copies the modified entries into a batch and
+ * returns; the writer thread then streams the batch to the base view. Until
+ * it's done, reads of the coins in the batch are answered from it, so the
+ * caller may evict them right away. At most one batch is in flight: the next
+ * BatchWrite waits for the previous one to finish.
+ *
+ * A BatchWrite that erases the caller's entries (CCoinsViewCache::Flush) and
+ * a Cursor() wait for the background write and then go straight to the base
+ * view, so the data is on disk when they return.
+ *
+ * Crash consistency is kept by the base view: CCoinsViewDB marks the range of
+ * blocks being written in its head blocks until the batch is complete.
+ */
+class CCoinsViewAsyncWriter final : public CCoinsViewBacked
+{
+    mutable Mutex m_mutex;
+    mutable std::condition_variable m_cv;
+    //! The batch being written, and the pool its map is allocated from.
+    std::unique_ptr<CCoinsMapMemoryResource> m_pending_resource GUARDED_BY(m_mutex);
+    std::unique_ptr<CCoinsMap> m_pending GUARDED_BY(m_mutex);
+    uint256 m_pending_block GUARDED_BY(m_mutex);
+    //! Set if writing a batch failed. The batch is kept, so reads stay correct.
+    bool m_write_failed GUARDED_BY(m_mutex){false};
+    bool m_stop GUARDED_BY(m_mutex){false};
+    std::thread m_thread;
+
+    void ThreadWrite();
+
+public:
+    explicit CCoinsViewAsyncWriter(CCoinsView* view);
+    //! Finishes the batch being written, if any.
+    ~CCoinsViewAsyncWriter();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock, bool erase = true) override;
+    CCoinsViewCursor *Cursor() const override;
+
+    //! Wait until the batch being written, if any, is on disk.
+    //! @returns false if writing it failed
+    bool WaitForWrite() const;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -83,9 +151,18 @@ public:
     bool Valid() const override;
     void Next() override;
 
+    CCoinsViewCursor* Clone() const override;
+    void Seek(const uint256& txid) override;
+
 private:
-    CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
-        CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
+    CCoinsViewDBCursor(CDBWrapper& db, CDBWrapper::Snapshot snapshot, const uint256 &hashBlockIn):
+        CCoinsViewCursor(hashBlockIn), m_db(db), m_snapshot(std::move(snapshot)), pcursor(m_db.NewIterator(m_snapshot)) {}
+    //! Read the key at the iterator's position into keyTmp.
+    void CacheKey();
+
+    CDBWrapper& m_db;
+    //! The state iterated over, shared with the clones of this cursor.
+    const CDBWrapper::Snapshot m_snapshot;
     std::unique_ptr<CDBIterator> pcursor;
     std::pair<char, COutPoint> keyTmp;
 
@@ -59,25 +59,32 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    CTxMemPoolEntry::Children stageEntries, descendants;
-    stageEntries = updateIt->GetMemPoolChildrenConst();
-
-    while (!stageEntries.empty()) {
-        const CTxMemPoolEntry& descendant = *stageEntries.begin();
-        descendants.insert(descendant);
-        stageEntries.erase(descendant);
-        const CTxMemPoolEntry::Children& children = descendant.GetMemPoolChildrenConst();
-        for (const CTxMemPoolEntry& childEntry : children) {
-            cacheMap::iterator cacheIt = cachedDescendants.find(mapTx.iterator_to(childEntry));
-            if (cacheIt != cachedDescendants.end()) {
-                // We've already calculated this one, just add the entries for this set
-                // but don't traverse again.
-                for (txiter cacheEntry : cacheIt->second) {
-                    descendants.insert(*cacheEntry);
+    std::vector<txiter> stageEntries, descendants;
+    {
+        const auto epoch = GetFreshEpoch();
+        for (const CTxMemPoolEntry& child : updateIt->GetMemPoolChildrenConst()) {
+            txiter childIt = mapTx.iterator_to(child);
+            if (!visited(childIt)) stageEntries.push_back(childIt);
+        }
+
+        while (!stageEntries.empty()) {
+            txiter descendantIt = stageEntries.back();
+            stageEntries.pop_back();
+            descendants.push_back(descendantIt);
+            const CTxMemPoolEntry::Children& children = descendantIt->GetMemPoolChildrenConst();
+            for (const CTxMemPoolEntry& childEntry : children) {
+                txiter childIt = mapTx.iterator_to(childEntry);
+                cacheMap::iterator cacheIt = cachedDescendants.find(childIt);
+                if (cacheIt != cachedDescendants.end()) {
+                    // We've already calculated this one, just add the entries for this set
+                    // but don't traverse again.
+                    for (txiter cacheEntry : cacheIt->second) {
+                        if (!visited(cacheEntry)) descendants.push_back(cacheEntry);
+                    }
+                } else if (!visited(childIt)) {
+                    // Schedule for later processing
+                    stageEntries.push_back(childIt);
                 }
-            } else if (!descendants.count(childEntry)) {
-                // Schedule for later processing
-                stageEntries.insert(childEntry);
             }
         }
     }
@@ -86,14 +93,14 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (const CTxMemPoolEntry& descendant : descendants) {
-        if (!setExclude.count(descendant.GetTx().GetHash())) {
-            modifySize += descendant.GetTxSize();
-            modifyFee += descendant.GetModifiedFee();
+    for (txiter descendantIt : descendants) {
+        if (!setExclude.count(descendantIt->GetTx().GetHash())) {
+            modifySize += descendantIt->GetTxSize();
+            modifyFee += descendantIt->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(mapTx.iterator_to(descendant));
+            cachedDescendants[updateIt].insert(descendantIt);
             // Update ancestor state for each descendant
-            mapTx.modify(mapTx.iterator_to(descendant), update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+            mapTx.modify(descendantIt, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
@@ -151,7 +158,10 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    CTxMemPoolEntry::Parents staged_ancestors;
+    // Every entry is staged at most once, as tracked by the epoch, so that the
+    // walk does not need a set lookup per visited parent.
+    const auto epoch = GetFreshEpoch();
+    std::vector<txiter> staged_ancestors;
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -160,8 +170,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             Optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                staged_ancestors.insert(**piter);
+            if (piter && !visited(*piter)) {
+                staged_ancestors.push_back(*piter);
                 if (staged_ancestors.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -172,17 +182,19 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        staged_ancestors = it->GetMemPoolParentsConst();
+        for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+            txiter parent_it = mapTx.iterator_to(parent);
+            if (!visited(parent_it)) staged_ancestors.push_back(parent_it);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!staged_ancestors.empty()) {
-        const CTxMemPoolEntry& stage = staged_ancestors.begin()->get();
-        txiter stageit = mapTx.iterator_to(stage);
+        txiter stageit = staged_ancestors.back();
+        staged_ancestors.pop_back();
 
         setAncestors.insert(stageit);
-        staged_ancestors.erase(stage);
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -201,8 +213,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             txiter parent_it = mapTx.iterator_to(parent);
 
             // If this is a new ancestor, add it.
-            if (setAncestors.count(parent_it) == 0) {
-                staged_ancestors.insert(parent);
+            if (!visited(parent_it)) {
+                staged_ancestors.push_back(parent_it);
             }
             if (staged_ancestors.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -253,6 +265,10 @@ void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
+    if (updateDescendants && entriesToRemove.size() > 1) {
+        UpdateForRemoveFromMempoolBatch(entriesToRemove);
+        return;
+    }
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
     const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -311,6 +327,99 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
     }
 }
 
+void CTxMemPool::UpdateForRemoveFromMempoolBatch(const setEntries &entriesToRemove)
+{
+    // Rather than walking the ancestors and descendants of every removed entry,
+    // which is quadratic in the length of a chain that is removed at once (as
+    // when a block confirms it), collect the entries that stay in the mempool
+    // but are connected to removed ones, and update each of those once for all
+    // removed entries among its ancestors or descendants. The connected
+    // entries are found through the same links as in the per-entry case, so
+    // this is also correct in the middle of a reorg (see
+    // UpdateForRemoveFromMempool).
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    std::vector<txiter> remaining_descendants, remaining_ancestors;
+    {
+        const auto epoch = GetFreshEpoch();
+        std::vector<txiter> stage(entriesToRemove.begin(), entriesToRemove.end());
+        for (txiter removeIt : entriesToRemove) visited(removeIt);
+        while (!stage.empty()) {
+            txiter it = stage.back();
+            stage.pop_back();
+            for (const CTxMemPoolEntry& child : it->GetMemPoolChildrenConst()) {
+                txiter childIt = mapTx.iterator_to(child);
+                if (!visited(childIt)) {
+                    remaining_descendants.push_back(childIt);
+                    stage.push_back(childIt);
+                }
+            }
+        }
+    }
+    {
+        const auto epoch = GetFreshEpoch();
+        std::vector<txiter> stage(entriesToRemove.begin(), entriesToRemove.end());
+        for (txiter removeIt : entriesToRemove) visited(removeIt);
+        while (!stage.empty()) {
+            txiter it = stage.back();
+            stage.pop_back();
+            for (const CTxMemPoolEntry& parent : it->GetMemPoolParentsConst()) {
+                txiter parentIt = mapTx.iterator_to(parent);
+                if (!visited(parentIt)) {
+                    remaining_ancestors.push_back(parentIt);
+                    stage.push_back(parentIt);
+                }
+            }
+        }
+    }
+
+    for (txiter descendantIt : remaining_descendants) {
+        setEntries setAncestors;
+        std::string dummy;
+        CalculateMemPoolAncestors(*descendantIt, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        int64_t modifySize = 0;
+        CAmount modifyFee = 0;
+        int64_t modifyCount = 0;
+        int64_t modifySigOps = 0;
+        for (txiter ancestorIt : setAncestors) {
+            if (entriesToRemove.count(ancestorIt)) {
+                modifySize -= ancestorIt->GetTxSize();
+                modifyFee -= ancestorIt->GetModifiedFee();
+                modifyCount--;
+                modifySigOps -= ancestorIt->GetSigOpCost();
+            }
+        }
+        mapTx.modify(descendantIt, update_ancestor_state(modifySize, modifyFee, modifyCount, modifySigOps));
+    }
+    for (txiter ancestorIt : remaining_ancestors) {
+        setEntries setDescendants;
+        CalculateDescendants(ancestorIt, setDescendants);
+        int64_t modifySize = 0;
+        CAmount modifyFee = 0;
+        int64_t modifyCount = 0;
+        for (txiter descendantIt : setDescendants) {
+            if (entriesToRemove.count(descendantIt)) {
+                modifySize -= descendantIt->GetTxSize();
+                modifyFee -= descendantIt->GetModifiedFee();
+                modifyCount--;
+            }
+        }
+        mapTx.modify(ancestorIt, update_descendant_state(modifySize, modifyFee, modifyCount));
+    }
+
+    // Now sever the links between the removed entries and their in-mempool
+    // parents and children, like UpdateAncestorsOf and UpdateChildrenForRemoval
+    // do in the per-entry case.
+    for (txiter removeIt : entriesToRemove) {
+        CTxMemPoolEntry::Parents parents = removeIt->GetMemPoolParents();
+        for (const CTxMemPoolEntry& parent : parents) {
+            UpdateChild(mapTx.iterator_to(parent), removeIt, false);
+        }
+    }
+    for (txiter removeIt : entriesToRemove) {
+        UpdateChildrenForRemoval(removeIt);
+    }
+}
+
 void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount)
 {
     nSizeWithDescendants += modifySize;
@@ -452,23 +561,25 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
+    if (setDescendants.count(entryit)) {
+        return;
     }
+    const auto epoch = GetFreshEpoch();
+    std::vector<txiter> stage{entryit};
+    visited(entryit);
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
+        stage.pop_back();
         setDescendants.insert(it);
-        stage.erase(it);
 
         const CTxMemPoolEntry::Children& children = it->GetMemPoolChildrenConst();
         for (const CTxMemPoolEntry& child : children) {
             txiter childiter = mapTx.iterator_to(child);
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!visited(childiter) && !setDescendants.count(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -575,13 +686,20 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
     // Before the txs in the new block have been removed from the mempool, update policy estimates
     if (minerPolicyEstimator) {minerPolicyEstimator->processBlock(nBlockHeight, entries);}
+    // Update the state of the remaining mempool for all in-block transactions
+    // at once, which only visits the transactions connected to them once
+    // instead of for every in-block ancestor. Removal and conflict handling
+    // still happen in block order.
+    setEntries stage;
+    for (const CTxMemPoolEntry* entry : entries) {
+        stage.insert(mapTx.iterator_to(*entry));
+    }
+    UpdateForRemoveFromMempool(stage, true);
     for (const auto& tx : vtx)
     {
         txiter it = mapTx.find(tx->GetHash());
         if (it != mapTx.end()) {
-            setEntries stage;
-            stage.insert(it);
-            RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
+            removeUnchecked(it, MemPoolRemovalReason::BLOCK);
         }
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
@@ -820,6 +938,22 @@ CTransactionRef CTxMemPool::get(const uint256& hash) const
     return i->GetSharedTx();
 }
 
+size_t CTxMemPool::ShareTransactions(std::vector<CTransactionRef>& txs) const
+{
+    HashTransactions(txs);
+    size_t shared = 0;
+    LOCK(cs);
+    const auto& by_wtxid = mapTx.get<index_by_wtxid>();
+    for (CTransactionRef& tx : txs) {
+        auto it = by_wtxid.find(tx->GetWitnessHash());
+        if (it != by_wtxid.end() && it->GetSharedTx() != tx) {
+            tx = it->GetSharedTx();
+            ++shared;
+        }
+    }
+    return shared;
+}
+
 TxMempoolInfo CTxMemPool::info(const GenTxid& gtxid) const
 {
     LOCK(cs);
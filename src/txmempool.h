@@ -577,7 +577,7 @@ public:
     indexed_transaction_set mapTx GUARDED_BY(cs);
 
     using txiter = indexed_transaction_set::nth_index<0>::type::const_iterator;
-    std::vector<std::pair<uint256, txiter>> vTxHashes GUARDED_BY(cs); //!< All tx witness hashes/entries in mapTx, in random order
+    std::vector<std::pair<uint256, txiter>> vTxHashes GUARDED_BY(cs); //!< All tx witness hashes/entries in mapTx, in the order they were added, except that a removal moves the last entry into its slot
 
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
@@ -744,6 +744,10 @@ public:
     bool exists(const uint256& txid) const { return exists(GenTxid{false, txid}); }
 
     CTransactionRef get(const uint256& hash) const;
+    /** Replace the transactions that are in the mempool (same wtxid) by the
+     *  mempool's copies, so they are shared rather than duplicated. Returns
+     *  the number of transactions replaced. */
+    size_t ShareTransactions(std::vector<CTransactionRef>& txs) const;
     txiter get_iter_from_wtxid(const uint256& wtxid) const EXCLUSIVE_LOCKS_REQUIRED(cs)
     {
         AssertLockHeld(cs);
@@ -815,6 +819,11 @@ private:
       * If updateDescendants is true, then also update in-mempool descendants'
       * ancestor state. */
     void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** UpdateForRemoveFromMempool with updateDescendants for more than one
+      * entry, as when a block confirms them: visits each entry connected to
+      * the removed ones once, rather than once per removed ancestor or
+      * descendant of it. */
+    void UpdateForRemoveFromMempoolBatch(const setEntries &entriesToRemove) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** Sever link between specified transaction and direct children. */
     void UpdateChildrenForRemoval(txiter entry) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -20,7 +20,10 @@
 #include <index/txindex.h>
 #include <logging.h>
 #include <logging/timer.h>
+#include <memusage.h>
+#include <node/coinstats.h>
 #include <node/ui_interface.h>
+#include <node/utxo_snapshot.h>
 #include <optional.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
@@ -28,12 +31,14 @@
 #include <pow.h>
 #include <primitives/block.h>
 #include <primitives/transaction.h>
+#include <pubkey.h>
 #include <random.h>
 #include <reverse_iterator.h>
 #include <script/script.h>
 #include <script/sigcache.h>
 #include <shutdown.h>
 #include <signet.h>
+#include <streams.h>
 #include <timedata.h>
 #include <tinyformat.h>
 #include <txdb.h>
@@ -49,7 +54,14 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <numeric>
 #include <string>
+#include <thread>
+#include <unordered_set>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -72,6 +84,8 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static constexpr std::chrono::hours DATABASE_WRITE_INTERVAL{1};
 /** Time to wait between flushing chainstate to disk. */
 static constexpr std::chrono::hours DATABASE_FLUSH_INTERVAL{24};
+/** Percentage of its space the coins cache is trimmed to when it is written to disk for being too large. */
+static constexpr int64_t COINS_CACHE_EVICT_TARGET_PERCENT{80};
 /** Maximum age of our tip for us to be considered current for fee estimation */
 static constexpr std::chrono::hours MAX_FEE_ESTIMATION_TIP_AGE{3};
 const std::vector<std::string> CHECKLEVEL_DOC {
@@ -133,6 +147,7 @@ Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 bool g_parallel_script_checks{false};
+bool g_parallel_input_fetch{false};
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -140,6 +155,7 @@ bool fPruneMode = false;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+int64_t g_defer_undo_depth = DEFAULT_DEFER_UNDO_DEPTH;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 
@@ -1233,6 +1249,92 @@ bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex
     return ReadRawBlockFromDisk(block, block_pos, message_start);
 }
 
+namespace {
+struct MappedBlockFile {
+    std::shared_ptr<const MappedFlatFile> mapping;
+    uint64_t last_used;
+};
+
+Mutex g_mapped_block_files_mutex;
+/** Block files mapped for serving raw blocks, by file number */
+std::map<int, MappedBlockFile> g_mapped_block_files GUARDED_BY(g_mapped_block_files_mutex);
+uint64_t g_mapped_block_files_uses GUARDED_BY(g_mapped_block_files_mutex){0};
+} // namespace
+
+/** Get a mapping of block file nFile that covers at least its first min_size bytes. */
+static std::shared_ptr<const MappedFlatFile> GetMappedBlockFile(int nFile, size_t min_size)
+{
+    LOCK(g_mapped_block_files_mutex);
+    auto it = g_mapped_block_files.find(nFile);
+    if (it == g_mapped_block_files.end() || it->second.mapping->Data().size() < min_size) {
+        // Not mapped yet, or data was appended to the file after it was mapped.
+        // Peers still sending from an older mapping keep it alive until they are done.
+        std::shared_ptr<const MappedFlatFile> mapping = BlockFileSeq().Map(FlatFilePos(nFile, 0));
+        if (!mapping || mapping->Data().size() < min_size) {
+            return nullptr;
+        }
+        if (it == g_mapped_block_files.end()) {
+            if (g_mapped_block_files.size() >= MAX_MAPPED_BLOCK_FILES) {
+                auto lru = std::min_element(g_mapped_block_files.begin(), g_mapped_block_files.end(),
+                    [](const std::pair<const int, MappedBlockFile>& a, const std::pair<const int, MappedBlockFile>& b) {
+                        return a.second.last_used < b.second.last_used;
+                    });
+                g_mapped_block_files.erase(lru);
+            }
+            it = g_mapped_block_files.emplace(nFile, MappedBlockFile{}).first;
+        }
+        it->second.mapping = std::move(mapping);
+    }
+    it->second.last_used = ++g_mapped_block_files_uses;
+    return it->second.mapping;
+}
+
+bool MapRawBlockFromDisk(std::shared_ptr<const void>& owner, Span<const uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    // Mapping whole block files would quickly exhaust a 32-bit address space
+    if (sizeof(void*) < 8 || pos.IsNull() || pos.nPos < 8) {
+        return false;
+    }
+
+    // The block is preceded by an 8 byte meta header
+    std::shared_ptr<const MappedFlatFile> mapping = GetMappedBlockFile(pos.nFile, pos.nPos);
+    if (!mapping) {
+        return false;
+    }
+    const uint8_t* header = mapping->Data().data() + pos.nPos - 8;
+    if (memcmp(header, message_start, CMessageHeader::MESSAGE_START_SIZE)) {
+        return error("%s: Block magic mismatch for %s: %s versus expected %s", __func__, pos.ToString(),
+                HexStr(Span<const uint8_t>(header, CMessageHeader::MESSAGE_START_SIZE)),
+                HexStr(message_start));
+    }
+    const unsigned int blk_size = ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+    if (blk_size > MAX_SIZE) {
+        return error("%s: Block data is larger than maximum deserialization size for %s: %s versus %s", __func__, pos.ToString(),
+                blk_size, MAX_SIZE);
+    }
+
+    if (mapping->Data().size() - pos.nPos < blk_size) {
+        mapping = GetMappedBlockFile(pos.nFile, size_t{pos.nPos} + blk_size);
+        if (!mapping) {
+            return error("%s: Block data past the end of the file for %s", __func__, pos.ToString());
+        }
+    }
+    block = mapping->Data().subspan(pos.nPos, blk_size);
+    owner = std::move(mapping);
+    return true;
+}
+
+bool MapRawBlockFromDisk(std::shared_ptr<const void>& owner, Span<const uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    FlatFilePos block_pos;
+    {
+        LOCK(cs_main);
+        block_pos = pindex->GetBlockPos();
+    }
+
+    return MapRawBlockFromDisk(owner, block, block_pos, message_start);
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1262,11 +1364,12 @@ CoinsViews::CoinsViews(
     bool in_memory,
     bool should_wipe) : m_dbview(
                             GetDataDir() / ldb_name, cache_size_bytes, in_memory, should_wipe),
-                        m_catcherview(&m_dbview) {}
+                        m_catcherview(&m_dbview),
+                        m_writerview(&m_catcherview) {}
 
 void CoinsViews::InitCache()
 {
-    m_cacheview = MakeUnique<CCoinsViewCache>(&m_catcherview);
+    m_cacheview = MakeUnique<CCoinsViewCache>(&m_writerview);
 }
 
 CChainState::CChainState(CTxMemPool& mempool, BlockManager& blockman, uint256 from_snapshot_blockhash)
@@ -1472,9 +1575,36 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
 }
 
 bool CScriptCheck::operator()() {
+    return (*this)(nullptr);
+}
+
+bool CScriptCheck::operator()(BatchSchnorrVerifier* batch) {
     const CScript &scriptSig = ptxTo->vin[nIn].scriptSig;
     const CScriptWitness *witness = &ptxTo->vin[nIn].scriptWitness;
-    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata), &error);
+    return VerifyScript(scriptSig, m_tx_out.scriptPubKey, witness, nFlags, CachingTransactionSignatureChecker(ptxTo, nIn, m_tx_out.nValue, cacheStore, *txdata, cacheStore ? nullptr : batch), &error);
+}
+
+template <>
+bool RunChecks(std::vector<CScriptCheck>& checks)
+{
+    BatchSchnorrVerifier batch;
+    for (CScriptCheck& check : checks) {
+        if (!check(&batch)) return false;
+    }
+    if (batch.Verify()) return true;
+    // Some signature in the batch is invalid; find the check it belongs to.
+    for (CScriptCheck& check : checks) {
+        if (!check()) return false;
+    }
+    return true;
+}
+
+bool CInputFetch::operator()() {
+    if (!m_view->GetCoin(m_outpoint, *m_coin)) {
+        m_coin->Clear();
+    }
+    // A missing input is not an error here; ConnectBlock will report it.
+    return true;
 }
 
 int GetSpendHeight(const CCoinsViewCache& inputs)
@@ -1487,15 +1617,22 @@ int GetSpendHeight(const CCoinsViewCache& inputs)
 
 static CuckooCache::cache<uint256, SignatureCacheHasher> g_scriptExecutionCache;
 static CSHA256 g_scriptExecutionCacheHasher;
+static uint256 g_scriptExecutionCacheNonce;
 
-void InitScriptExecutionCache() {
-    // Setup the salted hasher
-    uint256 nonce = GetRandHash();
+static void SetScriptExecutionCacheNonce(const uint256& nonce)
+{
     // We want the nonce to be 64 bytes long to force the hasher to process
     // this chunk, which makes later hash computations more efficient. We
     // just write our 32-byte entropy twice to fill the 64 bytes.
+    g_scriptExecutionCacheNonce = nonce;
+    g_scriptExecutionCacheHasher.Reset();
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
     g_scriptExecutionCacheHasher.Write(nonce.begin(), 32);
+}
+
+void InitScriptExecutionCache() {
+    // Setup the salted hasher
+    SetScriptExecutionCacheNonce(GetRandHash());
     // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
     // setup_bytes creates the minimum possible cache (2 elements).
     size_t nMaxCacheSize = std::min(std::max((int64_t)0, gArgs.GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
@@ -1635,10 +1772,16 @@ static bool UndoWriteToDisk(const CBlockUndo& blockundo, FlatFilePos& pos, const
     return true;
 }
 
+static bool RebuildUndoData(CBlockUndo& blockundo, const CBlockIndex* pindex);
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex)
 {
     FlatFilePos pos = pindex->GetUndoPos();
     if (pos.IsNull()) {
+        // A block that was connected but has no undo data had its undo write deferred.
+        if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
+            return RebuildUndoData(blockundo, pindex);
+        }
         return error("%s: no undo data available", __func__);
     }
 
@@ -1828,6 +1971,76 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, BlockValidationSt
     return true;
 }
 
+/**
+ * Rebuild the undo data of a connected block whose undo write was deferred
+ * (-deferundodepth), and write it to disk. The coins spent by the block are
+ * looked up in the block itself and then in the blocks before it, walking
+ * back until all of them are found. Most coins are spent soon after they are
+ * created, but a single old coin makes this read the chain back to it.
+ */
+static bool RebuildUndoData(CBlockUndo& blockundo, const CBlockIndex* pindex)
+{
+    const CChainParams& chainparams = Params();
+    int64_t nStart = GetTimeMillis();
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus())) {
+        return error("%s: failed to read block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    // The coins still to be found, by the txid of the transaction creating them.
+    std::unordered_map<uint256, std::vector<std::pair<uint32_t, Coin*>>, SaltedTxidHasher> missing;
+    blockundo.vtxundo.clear();
+    blockundo.vtxundo.resize(block.vtx.size() - 1);
+    for (size_t i = 1; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        CTxUndo& txundo = blockundo.vtxundo[i - 1];
+        txundo.vprevout.resize(tx.vin.size());
+        for (size_t j = 0; j < tx.vin.size(); ++j) {
+            missing[tx.vin[j].prevout.hash].emplace_back(tx.vin[j].prevout.n, &txundo.vprevout[j]);
+        }
+    }
+
+    const auto find_coins = [&missing](const CBlock& source, int height) {
+        for (size_t i = 0; i < source.vtx.size(); ++i) {
+            const auto it = missing.find(source.vtx[i]->GetHash());
+            if (it == missing.end()) continue;
+            for (const std::pair<uint32_t, Coin*>& spent : it->second) {
+                if (spent.first < source.vtx[i]->vout.size()) {
+                    *spent.second = Coin(source.vtx[i]->vout[spent.first], height, i == 0);
+                }
+            }
+            missing.erase(it);
+        }
+    };
+
+    find_coins(block, pindex->nHeight);
+    int blocks_read = 0;
+    for (const CBlockIndex* walk = pindex->pprev; walk && !missing.empty(); walk = walk->pprev) {
+        if (ShutdownRequested()) return false;
+        CBlock source;
+        if (!ReadBlockFromDisk(source, walk, chainparams.GetConsensus())) {
+            return error("%s: failed to read block %s to rebuild undo data", __func__, walk->GetBlockHash().ToString());
+        }
+        find_coins(source, walk->nHeight);
+        ++blocks_read;
+    }
+    if (!missing.empty()) {
+        return error("%s: coins spent by block %s not found", __func__, pindex->GetBlockHash().ToString());
+    }
+    LogPrint(BCLog::BENCH, "Rebuilt undo data of block %s from %d earlier blocks in %dms\n", pindex->GetBlockHash().ToString(), blocks_read, GetTimeMillis() - nStart);
+
+    LOCK(cs_main);
+    CBlockIndex* pindex_write = LookupBlockIndex(pindex->GetBlockHash());
+    BlockValidationState state;
+    if (!pindex_write || !WriteUndoDataForBlock(blockundo, state, pindex_write, chainparams)) {
+        return error("%s: failed to write rebuilt undo data of block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    // Undo files other than the last one are not synced by FlushStateToDisk().
+    FlushUndoFile(pindex_write->nFile);
+    return true;
+}
+
 static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
 
 void ThreadScriptCheck(int worker_num) {
@@ -1835,6 +2048,158 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CInputFetch> inputfetchqueue(16);
+
+void ThreadInputFetch(int worker_num) {
+    util::ThreadRename(strprintf("inputfetch.%i", worker_num));
+    inputfetchqueue.Thread();
+}
+
+/** Return every prevout spent by the block that is not created earlier in the same block. */
+static std::vector<COutPoint> GetBlockPrevouts(const CBlock& block)
+{
+    std::unordered_set<uint256, SaltedTxidHasher> block_txids;
+    std::vector<COutPoint> prevouts;
+    for (const auto& tx : block.vtx) {
+        if (!tx->IsCoinBase()) {
+            for (const CTxIn& txin : tx->vin) {
+                if (!block_txids.count(txin.prevout.hash)) {
+                    prevouts.push_back(txin.prevout);
+                }
+            }
+        }
+        block_txids.insert(tx->GetHash());
+    }
+    return prevouts;
+}
+
+/**
+ * First stage of the block connection pipeline.
+ *
+ * While block N is being connected (and its scripts verified on the
+ * script-check threads), a dedicated thread reads block N+1 from disk,
+ * runs the context-free CheckBlock() on it (so the merkle root is already
+ * verified when ConnectBlock() gets to it) and gathers its prevouts for
+ * the input prefetcher. Only the block that was requested last is kept,
+ * and results are only handed out for that exact block, so blocks are
+ * still connected strictly in order on the calling thread.
+ */
+class CBlockReadAhead
+{
+private:
+    //! Mutex to protect the inner state
+    boost::mutex mutex;
+
+    //! The worker thread blocks on this when there is no request
+    boost::condition_variable condWorker;
+
+    //! The connecting thread blocks on this while a read is in progress
+    boost::condition_variable condMaster;
+
+    //! Hash of the requested block, null if there is none
+    uint256 hashBlock;
+    FlatFilePos pos;
+    const Consensus::Params* params{nullptr};
+
+    //! Whether the request has not been picked up by the worker yet
+    bool fPending{false};
+    //! Whether the worker is currently reading and checking the block
+    bool fBusy{false};
+
+    std::shared_ptr<const CBlock> pblock;
+    std::vector<COutPoint> vPrevouts;
+
+public:
+    //! Start reading pindex's block in the background, replacing any earlier request.
+    void Request(const CBlockIndex* pindex, const Consensus::Params& consensusParams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        hashBlock = pindex->GetBlockHash();
+        pos = pindex->GetBlockPos();
+        params = &consensusParams;
+        fPending = true;
+        pblock.reset();
+        vPrevouts.clear();
+        condWorker.notify_one();
+    }
+
+    /**
+     * Hand out the block read for hash, waiting for the read to finish if it
+     * is in progress. Returns false if that block was not requested, was not
+     * picked up by the worker yet, or could not be read; the caller should
+     * then read the block itself.
+     */
+    bool Take(const uint256& hash, std::shared_ptr<const CBlock>& block, std::vector<COutPoint>& prevouts)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (hashBlock.IsNull() || hashBlock != hash) return false;
+        if (fPending) {
+            // Not started yet (or no worker running): not worth waiting for.
+            fPending = false;
+            hashBlock.SetNull();
+            return false;
+        }
+        while (fBusy) {
+            condMaster.wait(lock);
+        }
+        hashBlock.SetNull();
+        if (!pblock) return false;
+        block = std::move(pblock);
+        prevouts = std::move(vPrevouts);
+        pblock.reset();
+        vPrevouts.clear();
+        return true;
+    }
+
+    //! Worker thread
+    void Thread()
+    {
+        while (true) {
+            uint256 hash;
+            FlatFilePos block_pos;
+            const Consensus::Params* consensusParams;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fPending) {
+                    condWorker.wait(lock);
+                }
+                fPending = false;
+                fBusy = true;
+                hash = hashBlock;
+                block_pos = pos;
+                consensusParams = params;
+            }
+
+            std::shared_ptr<CBlock> block = std::make_shared<CBlock>();
+            std::vector<COutPoint> prevouts;
+            if (ReadBlockFromDisk(*block, block_pos, *consensusParams) && block->GetHash() == hash) {
+                // On success the result is cached in block->fChecked. On failure
+                // ConnectBlock() repeats the check and reports it.
+                BlockValidationState state;
+                CheckBlock(*block, state, *consensusParams);
+                prevouts = GetBlockPrevouts(*block);
+            } else {
+                block.reset();
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fBusy = false;
+            if (!fPending && hashBlock == hash) {
+                pblock = std::move(block);
+                vPrevouts = std::move(prevouts);
+            }
+            condMaster.notify_all();
+        }
+    }
+};
+
+static CBlockReadAhead blockreadahead;
+
+void ThreadBlockReadAhead() {
+    util::ThreadRename("blkreadahead");
+    blockreadahead.Thread();
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -2235,7 +2600,11 @@ bool CChainState::ConnectBlock(const CBlock& block, BlockValidationState& state,
     if (fJustCheck)
         return true;
 
-    if (!WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
+    // Blocks far enough below the best header that a reorganization back
+    // through them is not expected may skip writing their undo data; it is
+    // rebuilt by UndoReadFromDisk() if it is ever needed.
+    const bool defer_undo = g_defer_undo_depth > 0 && pindexBestHeader && pindexBestHeader->nHeight - pindex->nHeight > g_defer_undo_depth;
+    if (!defer_undo && !WriteUndoDataForBlock(blockundo, state, pindex, chainparams))
         return false;
 
     if (!pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
@@ -2264,15 +2633,23 @@ CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(const CTxMemPool* tx_poo
         gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
 }
 
-CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(
+/** The space the coins cache may take up: its own share, plus what the mempool doesn't use of its own. */
+static int64_t CoinsCacheTotalSpace(
     const CTxMemPool* tx_pool,
     size_t max_coins_cache_size_bytes,
     size_t max_mempool_size_bytes)
 {
     const int64_t nMempoolUsage = tx_pool ? tx_pool->DynamicMemoryUsage() : 0;
+    return max_coins_cache_size_bytes + std::max<int64_t>(max_mempool_size_bytes - nMempoolUsage, 0);
+}
+
+CoinsCacheSizeState CChainState::GetCoinsCacheSizeState(
+    const CTxMemPool* tx_pool,
+    size_t max_coins_cache_size_bytes,
+    size_t max_mempool_size_bytes)
+{
     int64_t cacheSize = CoinsTip().DynamicMemoryUsage();
-    int64_t nTotalSpace =
-        max_coins_cache_size_bytes + std::max<int64_t>(max_mempool_size_bytes - nMempoolUsage, 0);
+    int64_t nTotalSpace = CoinsCacheTotalSpace(tx_pool, max_coins_cache_size_bytes, max_mempool_size_bytes);
 
     //! No need to periodic flush if at least this much space still available.
     static constexpr int64_t MAX_BLOCK_COINSDB_USAGE_BYTES = 10 * 1024 * 1024;  // 10MB
@@ -2384,6 +2761,12 @@ bool CChainState::FlushStateToDisk(
             if (fFlushForPrune) {
                 LOG_TIME_MILLIS_WITH_CATEGORY("unlink pruned files", BCLog::BENCH);
 
+                // After a crash, the blocks of the coins still being written
+                // in the background would be replayed, and they may be in
+                // these files.
+                if (!m_coins_views->m_writerview.WaitForWrite()) {
+                    return AbortNode(state, "Failed to write to coin database");
+                }
                 UnlinkPrunedFiles(setFilesToPrune);
             }
             nLastWrite = nNow;
@@ -2402,13 +2785,32 @@ bool CChainState::FlushStateToDisk(
                 return AbortNode(state, "Disk space is too low!", _("Disk space is too low!"));
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!CoinsTip().Flush())
-                return AbortNode(state, "Failed to write to coin database");
+            if (mode == FlushStateMode::ALWAYS) {
+                if (!CoinsTip().Flush())
+                    return AbortNode(state, "Failed to write to coin database");
+            } else {
+                // Keep the cache warm, so block validation doesn't have to
+                // refill it from disk: write the modified coins but keep them
+                // cached, and only make room by evicting the coldest ones.
+                // The coins are written in the background (see
+                // CCoinsViewAsyncWriter), so validation can go on meanwhile.
+                if (!CoinsTip().Sync())
+                    return AbortNode(state, "Failed to write to coin database");
+                if (cache_state >= CoinsCacheSizeState::LARGE) {
+                    LOG_TIME_MILLIS_WITH_CATEGORY("evict cold coins from cache", BCLog::BENCH);
+
+                    const int64_t total_space = CoinsCacheTotalSpace(&m_mempool, m_coinstip_cache_size_bytes,
+                        gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+                    const size_t evicted = CoinsTip().EvictColdCoins(total_space * COINS_CACHE_EVICT_TARGET_PERCENT / 100);
+                    LogPrint(BCLog::COINDB, "Evicted %u cold coins from the cache, %u coins (%.2fkB) left\n",
+                        evicted, CoinsTip().GetCacheSize(), CoinsTip().DynamicMemoryUsage() / 1000.0);
+                }
+            }
             nLastFlush = nNow;
             full_flush_completed = true;
         }
     }
-    if (full_flush_completed) {
+    if (full_flush_completed && !g_chainman.IsBackgroundIBD(this)) {
         // Update best block in wallet (so we can detect restored wallets).
         GetMainSignals().ChainStateFlushed(m_chain.GetLocator());
     }
@@ -2556,6 +2958,10 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
 
     m_chain.SetTip(pindexDelete->pprev);
 
+    if (g_chainman.IsBackgroundIBD(this)) {
+        LogPrintf("[snapshot] background chainstate disconnected block %s\n", pindexDelete->GetBlockHash().ToString());
+        return true;
+    }
     UpdateTip(m_mempool, pindexDelete->pprev, chainparams);
     // Let wallets know transactions went from 1-confirmed to
     // 0-confirmed or conflicted:
@@ -2564,6 +2970,7 @@ bool CChainState::DisconnectTip(BlockValidationState& state, const CChainParams&
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2609,6 +3016,39 @@ public:
     }
 };
 
+void CChainState::PrefetchBlockInputs(const std::vector<COutPoint>& prevouts)
+{
+    AssertLockHeld(cs_main);
+
+    // Only the prevouts that are not already in the coins cache would hit
+    // the database one at a time while connecting.
+    std::vector<COutPoint> missing;
+    for (const COutPoint& prevout : prevouts) {
+        if (!CoinsTip().HaveCoinInCache(prevout)) {
+            missing.push_back(prevout);
+        }
+    }
+    if (missing.empty()) return;
+
+    // Look the coins up in parallel below the cache. The result slots must
+    // stay valid until `control` has finished, so size the vector up front.
+    std::vector<Coin> coins(missing.size());
+    {
+        CCheckQueueControl<CInputFetch> control(&inputfetchqueue);
+        std::vector<CInputFetch> vChecks;
+        vChecks.reserve(missing.size());
+        for (size_t i = 0; i < missing.size(); ++i) {
+            vChecks.emplace_back(m_coins_views->m_writerview, missing[i], coins[i]);
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    for (size_t i = 0; i < missing.size(); ++i) {
+        CoinsTip().EmplaceCoinFromBase(missing[i], std::move(coins[i]));
+    }
+}
+
 /**
  * Connect a new block to m_chain. pblock is either nullptr or a pointer to a CBlock
  * corresponding to pindexNew, to bypass loading it again from disk.
@@ -2624,11 +3064,17 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
     std::shared_ptr<const CBlock> pthisBlock;
+    std::vector<COutPoint> prevouts;
+    bool fHavePrevouts = false;
     if (!pblock) {
-        std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
-        if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
-            return AbortNode(state, "Failed to read block");
-        pthisBlock = pblockNew;
+        if (blockreadahead.Take(pindexNew->GetBlockHash(), pthisBlock, prevouts)) {
+            fHavePrevouts = true;
+        } else {
+            std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
+            if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
+                return AbortNode(state, "Failed to read block");
+            pthisBlock = pblockNew;
+        }
     } else {
         pthisBlock = pblock;
     }
@@ -2637,6 +3083,13 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    if (g_parallel_input_fetch) {
+        if (!fHavePrevouts) prevouts = GetBlockPrevouts(blockConnecting);
+        PrefetchBlockInputs(prevouts);
+        int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+        LogPrint(BCLog::BENCH, "  - Prefetch inputs: %.2fms [%.2fs]\n", (nTimePrefetched - nTime2) * MILLI, nTimePrefetch * MICRO);
+        nTime2 = nTimePrefetched;
+    }
     {
         CCoinsViewCache view(&CoinsTip());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2659,12 +3112,19 @@ bool CChainState::ConnectTip(BlockValidationState& state, const CChainParams& ch
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO, nTimeChainState * MILLI / nBlocksTotal);
-    // Remove conflicting transactions from the mempool.;
-    m_mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
-    disconnectpool.removeForBlock(blockConnecting.vtx);
-    // Update m_chain & related variables.
-    m_chain.SetTip(pindexNew);
-    UpdateTip(m_mempool, pindexNew, chainparams);
+    if (g_chainman.IsBackgroundIBD(this)) {
+        // The mempool and everything else outside validation follow the
+        // active (snapshot) chainstate, not this one.
+        m_chain.SetTip(pindexNew);
+        LogPrintf("[snapshot] background chainstate new best=%s height=%d\n", pindexNew->GetBlockHash().ToString(), pindexNew->nHeight);
+    } else {
+        // Remove conflicting transactions from the mempool.;
+        m_mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
+        disconnectpool.removeForBlock(blockConnecting.vtx);
+        // Update m_chain & related variables.
+        m_chain.SetTip(pindexNew);
+        UpdateTip(m_mempool, pindexNew, chainparams);
+    }
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
@@ -2758,12 +3218,13 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
 
     const CBlockIndex *pindexOldTip = m_chain.Tip();
     const CBlockIndex *pindexFork = m_chain.FindFork(pindexMostWork);
+    const bool is_background = g_chainman.IsBackgroundIBD(this);
 
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
     DisconnectedBlockTransactions disconnectpool;
     while (m_chain.Tip() && m_chain.Tip() != pindexFork) {
-        if (!DisconnectTip(state, chainparams, &disconnectpool)) {
+        if (!DisconnectTip(state, chainparams, is_background ? nullptr : &disconnectpool)) {
             // This is likely a fatal error, but keep the mempool consistent,
             // just in case. Only remove from the mempool in this case.
             UpdateMempoolForReorg(m_mempool, disconnectpool, false);
@@ -2795,7 +3256,14 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         nHeight = nTargetHeight;
 
         // Connect new blocks.
-        for (CBlockIndex *pindexConnect : reverse_iterate(vpindexToConnect)) {
+        for (auto it = vpindexToConnect.rbegin(); it != vpindexToConnect.rend(); ++it) {
+            CBlockIndex* pindexConnect = *it;
+            // Read and check the following block in the background while this
+            // one is being connected.
+            auto itNext = std::next(it);
+            if (itNext != vpindexToConnect.rend() && !(*itNext == pindexMostWork && pblock)) {
+                blockreadahead.Request(*itNext, chainparams.GetConsensus());
+            }
             if (!ConnectTip(state, chainparams, pindexConnect, pindexConnect == pindexMostWork ? pblock : std::shared_ptr<const CBlock>(), connectTrace, disconnectpool)) {
                 if (state.IsInvalid()) {
                     // The block violates a consensus rule.
@@ -2824,6 +3292,8 @@ bool CChainState::ActivateBestChainStep(BlockValidationState& state, const CChai
         }
     }
 
+    if (is_background) return true;
+
     if (fBlocksDisconnected) {
         // If any blocks were disconnected, disconnectpool may be non empty.  Add
         // any disconnected transactions back to the mempool.
@@ -2893,6 +3363,9 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
     CBlockIndex *pindexMostWork = nullptr;
     CBlockIndex *pindexNewTip = nullptr;
     int nStopAtHeight = gArgs.GetArg("-stopatheight", DEFAULT_STOPATHEIGHT);
+    // A chainstate validating a snapshot in the background does not notify
+    // anyone; the rest of the node only sees the active chainstate.
+    const bool is_background = WITH_LOCK(cs_main, return g_chainman.IsBackgroundIBD(this));
     do {
         // Block until the validation queue drains. This should largely
         // never happen in normal operation, however may happen during
@@ -2937,7 +3410,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
                 for (const PerBlockConnectTrace& trace : connectTrace.GetBlocksConnected()) {
                     assert(trace.pblock && trace.pindex);
-                    GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
+                    if (!is_background) GetMainSignals().BlockConnected(trace.pblock, trace.pindex);
                 }
             } while (!m_chain.Tip() || (starting_tip && CBlockIndexWorkComparator()(m_chain.Tip(), starting_tip)));
             if (!blocks_connected) return true;
@@ -2947,7 +3420,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
 
             // Notify external listeners about the new tip.
             // Enqueue while holding cs_main to ensure that UpdatedBlockTip is called in the order in which blocks are connected
-            if (pindexFork != pindexNewTip) {
+            if (pindexFork != pindexNewTip && !is_background) {
                 // Notify ValidationInterface subscribers
                 GetMainSignals().UpdatedBlockTip(pindexNewTip, pindexFork, fInitialDownload);
 
@@ -2957,7 +3430,7 @@ bool CChainState::ActivateBestChain(BlockValidationState &state, const CChainPar
         }
         // When we reach this point, we switched to a new tip (stored in pindexNewTip).
 
-        if (nStopAtHeight && pindexNewTip && pindexNewTip->nHeight >= nStopAtHeight) StartShutdown();
+        if (nStopAtHeight && pindexNewTip && pindexNewTip->nHeight >= nStopAtHeight && !is_background) StartShutdown();
 
         // We check shutdown only after giving ActivateBestChainStep a chance to run once so that we
         // never shutdown before connecting the genesis block during LoadChainTip(). Previously this
@@ -3200,7 +3673,8 @@ CBlockIndex* BlockManager::AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
+    CBlockIndex* pindexNew = NewBlockIndex();
+    *pindexNew = CBlockIndex(block);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -3882,6 +4356,10 @@ bool ChainstateManager::ProcessNewBlock(const CChainParams& chainparams, const s
     if (!::ChainstateActive().ActivateBestChain(state, chainparams, pblock))
         return error("%s: ActivateBestChain failed (%s)", __func__, state.ToString());
 
+    if (!ActivateBackgroundBestChain(chainparams)) {
+        return error("%s: ActivateBestChain failed for the background chainstate", __func__);
+    }
+
     return true;
 }
 
@@ -3965,6 +4443,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         FlatFilePos pos(*it, 0);
+        WITH_LOCK(g_mapped_block_files_mutex, g_mapped_block_files.erase(*it));
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -4088,6 +4567,17 @@ fs::path GetBlockPosFilename(const FlatFilePos &pos)
     return BlockFileSeq().FileName(pos);
 }
 
+CBlockIndex* BlockManager::NewBlockIndex()
+{
+    AssertLockHeld(cs_main);
+
+    if (m_block_index_chunk_used == BLOCK_INDEX_CHUNK_SIZE) {
+        m_block_index_chunks.emplace_back(new CBlockIndex[BLOCK_INDEX_CHUNK_SIZE]);
+        m_block_index_chunk_used = 0;
+    }
+    return &m_block_index_chunks.back()[m_block_index_chunk_used++];
+}
+
 CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
 {
     AssertLockHeld(cs_main);
@@ -4101,7 +4591,7 @@ CBlockIndex * BlockManager::InsertBlockIndex(const uint256& hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
+    CBlockIndex* pindexNew = NewBlockIndex();
     mi = m_block_index.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
@@ -4116,19 +4606,24 @@ bool BlockManager::LoadBlockIndex(
     if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) { return this->InsertBlockIndex(hash); }))
         return false;
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(m_block_index.size());
-    for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index)
-    {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+    // Calculate nChainWork, in height order. The heights are dense, so the
+    // entries are put in that order by counting them per height.
+    int max_height = -1;
+    for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index) {
+        max_height = std::max(max_height, item.second->nHeight);
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
+    std::vector<size_t> height_offsets(max_height + 2, 0);
+    for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index) {
+        ++height_offsets[item.second->nHeight + 1];
+    }
+    std::partial_sum(height_offsets.begin(), height_offsets.end(), height_offsets.begin());
+    std::vector<CBlockIndex*> vSortedByHeight(m_block_index.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : m_block_index) {
+        vSortedByHeight[height_offsets[item.second->nHeight]++] = item.second;
+    }
+    for (CBlockIndex* pindex : vSortedByHeight)
     {
         if (ShutdownRequested()) return false;
-        CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
@@ -4167,11 +4662,9 @@ void BlockManager::Unload() {
     m_failed_blocks.clear();
     m_blocks_unlinked.clear();
 
-    for (const BlockMap::value_type& entry : m_block_index) {
-        delete entry.second;
-    }
-
     m_block_index.clear();
+    m_block_index_chunks.clear();
+    m_block_index_chunk_used = BLOCK_INDEX_CHUNK_SIZE;
 }
 
 bool static LoadBlockIndexDB(ChainstateManager& chainman, const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
@@ -4679,19 +5172,100 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return ::ChainstateActive().LoadGenesisBlock(chainparams);
 }
 
-void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos* dbp)
+namespace {
+/** A block record found in a block file by the scan stage of a block import. */
+struct ScannedBlock {
+    std::shared_ptr<CBlock> block;
+    uint256 hash;
+    //! Where the block starts in its file. Only meaningful for blk files.
+    FlatFilePos pos;
+};
+
+/**
+ * The blocks found in one block file, handed over from the thread scanning
+ * the file to the thread accepting its blocks, in file order. The scanner
+ * waits once BLOCKFILE_SCAN_BUFFER_BYTES of blocks are waiting, so scanning
+ * ahead takes a bounded amount of memory per file.
+ */
+class BlockFileScan
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::pair<ScannedBlock, size_t>> m_blocks GUARDED_BY(m_mutex);
+    size_t m_bytes GUARDED_BY(m_mutex){0};
+    bool m_done GUARDED_BY(m_mutex){false};
+    bool m_opened GUARDED_BY(m_mutex){true};
+    bool m_aborted GUARDED_BY(m_mutex){false};
 
-    int nLoaded = 0;
+public:
+    //! Queue a block of the given serialized size. Returns false if the consumer gave up on the file.
+    bool Push(ScannedBlock&& block, size_t size)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_aborted || m_bytes == 0 || m_bytes + size <= BLOCKFILE_SCAN_BUFFER_BYTES; });
+        if (m_aborted) return false;
+        m_blocks.emplace_back(std::move(block), size);
+        m_bytes += size;
+        m_cv.notify_all();
+        return true;
+    }
+
+    //! Mark the file as fully scanned, or as impossible to open.
+    void Finish(bool opened = true)
+    {
+        LOCK(m_mutex);
+        m_done = true;
+        m_opened = opened;
+        m_cv.notify_all();
+    }
+
+    //! Stop the scanner of the file and drop the blocks it found.
+    void Abort()
+    {
+        LOCK(m_mutex);
+        m_aborted = true;
+        m_blocks.clear();
+        m_bytes = 0;
+        m_cv.notify_all();
+    }
+
+    //! Take the next block of the file. Returns false once the file is done.
+    bool Pop(ScannedBlock& block)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        m_cv.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_done || !m_blocks.empty(); });
+        if (m_blocks.empty()) return false;
+        block = std::move(m_blocks.front().first);
+        m_bytes -= m_blocks.front().second;
+        m_blocks.pop_front();
+        m_cv.notify_all();
+        return true;
+    }
+
+    //! Whether the file could be opened. Only valid once Pop() returned false.
+    bool Opened()
+    {
+        LOCK(m_mutex);
+        return m_opened;
+    }
+};
+} // namespace
+
+/**
+ * Scan stage of a block import: locate the block records in a file,
+ * deserialize and hash them, and run the context-free checks, whose result
+ * is cached in CBlock::fChecked so AcceptBlock() does not repeat them. A
+ * block failing the checks is queued anyway; AcceptBlock() repeats the check
+ * and reports it.
+ */
+static void ScanBlockFile(const CChainParams& chainparams, FILE* fileIn, const FlatFilePos* dbp, BlockFileScan& scan)
+{
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
         CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
         while (!blkdat.eof()) {
-            if (ShutdownRequested()) return;
+            if (ShutdownRequested()) break;
 
             blkdat.SetPos(nRewind);
             nRewind++; // start one byte further next time, in case of failure
@@ -4715,89 +5289,187 @@ void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFi
             }
             try {
                 // read block
+                ScannedBlock scanned;
                 uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
+                if (dbp) {
+                    scanned.pos = FlatFilePos(dbp->nFile, nBlockPos);
+                }
                 blkdat.SetLimit(nBlockPos + nSize);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
+                scanned.block = std::make_shared<CBlock>();
+                blkdat >> *scanned.block;
                 nRewind = blkdat.GetPos();
 
-                uint256 hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                                block.hashPrevBlock.ToString());
-                        if (dbp)
-                            mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                        continue;
-                    }
+                scanned.hash = scanned.block->GetHash();
+                BlockValidationState state;
+                CheckBlock(*scanned.block, state, chainparams.GetConsensus());
+                if (!scan.Push(std::move(scanned), nSize)) break;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            }
+        }
+    } catch (const std::runtime_error& e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
+    scan.Finish();
+}
 
-                    // process in case the block isn't known yet
-                    CBlockIndex* pindex = LookupBlockIndex(hash);
-                    if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
-                      BlockValidationState state;
-                      if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
-                          nLoaded++;
-                      }
-                      if (state.IsError()) {
-                          break;
-                      }
-                    } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
-                      LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
-                    }
+/**
+ * Acceptance stage of a block import: accept the blocks of a file in the
+ * order they were found, and the earlier encountered children of each of
+ * them. Blocks whose parent is not known yet are remembered by position and
+ * read again from disk once it is (only for blk files, i.e. with dbp set).
+ */
+static void AcceptScannedBlocks(const CChainParams& chainparams, BlockFileScan& scan, bool with_pos, int& nLoaded)
+{
+    // Map of disk positions for blocks with unknown parent (only used for reindex)
+    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
+
+    ScannedBlock scanned;
+    while (scan.Pop(scanned)) {
+        if (ShutdownRequested()) break;
+
+        try {
+            const std::shared_ptr<CBlock>& pblock = scanned.block;
+            const CBlock& block = *pblock;
+            const uint256& hash = scanned.hash;
+            FlatFilePos* dbp = with_pos ? &scanned.pos : nullptr;
+            {
+                LOCK(cs_main);
+                // detect out of order blocks, and store them for later
+                if (hash != chainparams.GetConsensus().hashGenesisBlock && !LookupBlockIndex(block.hashPrevBlock)) {
+                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                            block.hashPrevBlock.ToString());
+                    if (dbp)
+                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                    continue;
                 }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    BlockValidationState state;
-                    if (!ActivateBestChain(state, chainparams, nullptr)) {
-                        break;
-                    }
+                // process in case the block isn't known yet
+                CBlockIndex* pindex = LookupBlockIndex(hash);
+                if (!pindex || (pindex->nStatus & BLOCK_HAVE_DATA) == 0) {
+                  BlockValidationState state;
+                  if (::ChainstateActive().AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr)) {
+                      nLoaded++;
+                  }
+                  if (state.IsError()) {
+                      break;
+                  }
+                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && pindex->nHeight % 1000 == 0) {
+                  LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), pindex->nHeight);
                 }
+            }
+
+            // Activate the genesis block so normal node progress can continue
+            if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                BlockValidationState state;
+                if (!ActivateBestChain(state, chainparams, nullptr)) {
+                    break;
+                }
+            }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+            NotifyHeaderTip();
+
+            // Recursively process earlier encountered successors of this block
+            std::deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                std::pair<std::multimap<uint256, FlatFilePos>::iterator, std::multimap<uint256, FlatFilePos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    std::multimap<uint256, FlatFilePos>::iterator it = range.first;
+                    std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
+                    if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus()))
+                    {
+                        LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                                head.ToString());
+                        LOCK(cs_main);
+                        BlockValidationState dummy;
+                        if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
                         {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                    head.ToString());
-                            LOCK(cs_main);
-                            BlockValidationState dummy;
-                            if (::ChainstateActive().AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr))
-                            {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
+                            nLoaded++;
+                            queue.push_back(pblockrecursive->GetHash());
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
+                    NotifyHeaderTip();
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
     }
+    // Let the scanner go if the file was given up on early.
+    scan.Abort();
+}
+
+void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos* dbp)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    BlockFileScan scan;
+    std::thread scanner(&TraceThread<std::function<void()>>, "loadblk.scan", [&] { ScanBlockFile(chainparams, fileIn, dbp, scan); });
+    AcceptScannedBlocks(chainparams, scan, dbp != nullptr, nLoaded);
+    scanner.join();
     LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
 }
 
+void ReindexBlockFiles(const CChainParams& chainparams)
+{
+    int num_files = 0;
+    while (fs::exists(GetBlockPosFilename(FlatFilePos(num_files, 0)))) {
+        ++num_files;
+    }
+
+    // Every scanner works on its own file, so up to that many files are
+    // scanned ahead of the one being accepted.
+    const int num_scanners = std::max(1, std::min({GetNumCores(), MAX_BLOCKFILE_SCAN_THREADS, num_files}));
+    LogPrintf("Reindexing %d block files, scanning them on %d threads\n", num_files, num_scanners);
+
+    std::vector<std::unique_ptr<BlockFileScan>> scans;
+    for (int nFile = 0; nFile < num_files; ++nFile) {
+        scans.emplace_back(MakeUnique<BlockFileScan>());
+    }
+    std::atomic<int> next_file{0};
+    std::vector<std::thread> scanners;
+    for (int i = 0; i < num_scanners; ++i) {
+        scanners.emplace_back(&TraceThread<std::function<void()>>, "loadblk.scan", [&] {
+            int nFile;
+            while ((nFile = next_file++) < num_files) {
+                const FlatFilePos pos(nFile, 0);
+                FILE* file = OpenBlockFile(pos, true);
+                if (!file) {
+                    // This error is logged in OpenBlockFile
+                    scans[nFile]->Finish(/* opened */ false);
+                    continue;
+                }
+                ScanBlockFile(chainparams, file, &pos, *scans[nFile]);
+            }
+        });
+    }
+
+    for (int nFile = 0; nFile < num_files; ++nFile) {
+        int64_t nStart = GetTimeMillis();
+        int nLoaded = 0;
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
+        AcceptScannedBlocks(chainparams, *scans[nFile], /* with_pos */ true, nLoaded);
+        if (!scans[nFile]->Opened() || ShutdownRequested()) {
+            // Stop the scanners of the files after this one.
+            next_file = num_files;
+            for (int i = nFile + 1; i < num_files; ++i) {
+                scans[i]->Abort();
+            }
+            break;
+        }
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    }
+    for (std::thread& scanner : scanners) {
+        scanner.join();
+    }
+}
+
 void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 {
     if (!fCheckBlockIndex) {
@@ -4806,6 +5478,12 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
 
     LOCK(cs_main);
 
+    // Snapshot activation fakes nChainTx for the blocks below the snapshot base
+    // that were not downloaded yet, which breaks the invariants checked here.
+    if (g_chainman.SnapshotBlockhash() && !g_chainman.SnapshotBlockhash()->IsNull()) {
+        return;
+    }
+
     // During a reindex, we read the genesis block and call CheckBlockIndex before ActivateBestChain,
     // so we have the genesis block in m_blockman.m_block_index but no active chain. (A few of the
     // tests when iterating the block tree require that m_chain has been initialized.)
@@ -5000,6 +5678,11 @@ bool CChainState::ResizeCoinsCaches(size_t coinstip_size, size_t coinsdb_size)
     size_t old_coinstip_size = m_coinstip_cache_size_bytes;
     m_coinstip_cache_size_bytes = coinstip_size;
     m_coinsdb_cache_size_bytes = coinsdb_size;
+    // Resizing reopens the database, which must not be written to meanwhile.
+    if (!m_coins_views->m_writerview.WaitForWrite()) {
+        BlockValidationState state;
+        return AbortNode(state, "Failed to write to coin database");
+    }
     CoinsDB().ResizeCache(coinsdb_size);
 
     LogPrintf("[%s] resized coinsdb cache to %.1f MiB\n",
@@ -5207,6 +5890,80 @@ bool DumpMempool(const CTxMemPool& pool)
     return true;
 }
 
+static const uint64_t SCRIPT_CACHES_DUMP_VERSION = 1;
+
+bool LoadScriptCaches()
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "scriptcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open script caches file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    try {
+        uint64_t version;
+        file >> version;
+        if (version != SCRIPT_CACHES_DUMP_VERSION) {
+            return false;
+        }
+        file >> sig_nonce >> sig_entries;
+        file >> script_nonce >> script_entries;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize script caches data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    AddSignatureCacheEntries(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        SetScriptExecutionCacheNonce(script_nonce);
+        for (const uint256& entry : script_entries) {
+            g_scriptExecutionCache.insert(entry);
+        }
+    }
+    LogPrintf("Imported script caches from disk: %u signature cache entries, %u script execution cache entries\n", sig_entries.size(), script_entries.size());
+    return true;
+}
+
+bool DumpScriptCaches()
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    GetSignatureCacheEntries(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        script_nonce = g_scriptExecutionCacheNonce;
+        g_scriptExecutionCache.for_each_live([&](const uint256& entry) { script_entries.push_back(entry); });
+    }
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "scriptcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << SCRIPT_CACHES_DUMP_VERSION;
+        file << sig_nonce << sig_entries;
+        file << script_nonce << script_entries;
+
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        RenameOver(GetDataDir() / "scriptcache.dat.new", GetDataDir() / "scriptcache.dat");
+        LogPrintf("Dumped script caches: %u signature cache entries, %u script execution cache entries in %gs\n", sig_entries.size(), script_entries.size(), (GetTimeMicros() - start) * MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump script caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 //! require cs_main if pindex has not been validated yet (because nChainTx might be unset)
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
@@ -5326,6 +6083,14 @@ void ChainstateManager::MaybeRebalanceCaches()
         // Allocate everything to the snapshot chainstate.
         m_snapshot_chainstate->ResizeCoinsCaches(m_total_coinstip_cache, m_total_coinsdb_cache);
     }
+    else if (m_snapshot_chainstate && m_snapshot_validated) {
+        LogPrintf("[snapshot] allocating the cache to the validated snapshot chainstate\n");
+        // The background chainstate is done; shrink it before growing the snapshot.
+        m_ibd_chainstate->ResizeCoinsCaches(
+            m_total_coinstip_cache * 0.01, m_total_coinsdb_cache * 0.01);
+        m_snapshot_chainstate->ResizeCoinsCaches(
+            m_total_coinstip_cache * 0.99, m_total_coinsdb_cache * 0.99);
+    }
     else if (m_ibd_chainstate && m_snapshot_chainstate) {
         // If both chainstates exist, determine who needs more cache based on IBD status.
         //
@@ -5343,3 +6108,370 @@ void ChainstateManager::MaybeRebalanceCaches()
         }
     }
 }
+
+const AssumeutxoData* ExpectedAssumeutxo(int height, const CChainParams& chainparams)
+{
+    const MapAssumeutxo& valid_assumeutxos_map = chainparams.Assumeutxo();
+    const auto assumeutxo_found = valid_assumeutxos_map.find(height);
+
+    if (assumeutxo_found != valid_assumeutxos_map.end()) {
+        return &assumeutxo_found->second;
+    }
+    return nullptr;
+}
+
+bool ChainstateManager::ActivateSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, bool in_memory)
+{
+    uint256 base_blockhash = metadata.m_base_blockhash;
+
+    if (WITH_LOCK(::cs_main, return m_snapshot_chainstate != nullptr)) {
+        LogPrintf("[snapshot] can't activate a snapshot-based chainstate more than once\n");
+        return false;
+    }
+
+    int64_t current_coinsdb_cache_size{0};
+    int64_t current_coinstip_cache_size{0};
+
+    // Cache percentages to allocate to each chainstate.
+    //
+    // These particular percentages don't matter so much since they will only be
+    // relevant during snapshot activation; caches are rebalanced at the conclusion of
+    // this function. We want to give (essentially) all available cache capacity to the
+    // snapshot to aid the bulk load later in this function.
+    static constexpr double IBD_CACHE_PERC = 0.01;
+    static constexpr double SNAPSHOT_CACHE_PERC = 0.99;
+
+    std::unique_ptr<CChainState> snapshot_chainstate;
+    {
+        LOCK(::cs_main);
+        CChainState& active = ActiveChainstate();
+        if (active.m_mempool.size() > 0) {
+            LogPrintf("[snapshot] can't activate a snapshot with a non-empty mempool\n");
+            return false;
+        }
+        const CBlockIndex* snapshot_start_block = LookupBlockIndex(base_blockhash);
+        if (!snapshot_start_block) {
+            LogPrintf("[snapshot] didn't find snapshot start blockheader %s\n", base_blockhash.ToString());
+            return false;
+        }
+        if (ActiveHeight() >= snapshot_start_block->nHeight) {
+            LogPrintf("[snapshot] the active chain is already at or past the snapshot base block %s\n", base_blockhash.ToString());
+            return false;
+        }
+        if (!ExpectedAssumeutxo(snapshot_start_block->nHeight, ::Params())) {
+            LogPrintf("[snapshot] assumeutxo value in snapshot metadata not valid for height %s - refusing to load snapshot\n",
+                snapshot_start_block->nHeight);
+            return false;
+        }
+
+        // Resize the coins caches to ensure we're not exceeding memory limits.
+        //
+        // Allocate the majority of the cache to the incoming snapshot chainstate, since
+        // (optimistically) getting to its tip will be the top priority. We'll need to call
+        // `MaybeRebalanceCaches()` once we're done with this function to ensure
+        // the right allocation (including the possibility that no snapshot was activated
+        // and that we should restore the active chainstate caches to their original size).
+        current_coinsdb_cache_size = active.m_coinsdb_cache_size_bytes;
+        current_coinstip_cache_size = active.m_coinstip_cache_size_bytes;
+
+        // Temporarily resize the active coins cache to make room for the newly-created
+        // snapshot chain.
+        active.ResizeCoinsCaches(
+            static_cast<size_t>(current_coinstip_cache_size * IBD_CACHE_PERC),
+            static_cast<size_t>(current_coinsdb_cache_size * IBD_CACHE_PERC));
+
+        snapshot_chainstate.reset(new CChainState(active.m_mempool, m_blockman, base_blockhash));
+        snapshot_chainstate->InitCoinsDB(
+            static_cast<size_t>(current_coinsdb_cache_size * SNAPSHOT_CACHE_PERC),
+            in_memory, /* should_wipe */ true);
+        snapshot_chainstate->InitCoinsCache(
+            static_cast<size_t>(current_coinstip_cache_size * SNAPSHOT_CACHE_PERC));
+    }
+
+    const bool snapshot_ok = this->PopulateAndValidateSnapshot(
+        *snapshot_chainstate, coins_file, metadata);
+
+    LOCK(::cs_main);
+    if (!snapshot_ok) {
+        // Give the caches back to the active chainstate.
+        this->MaybeRebalanceCaches();
+        return false;
+    }
+
+    assert(!m_snapshot_chainstate);
+    m_snapshot_chainstate.swap(snapshot_chainstate);
+    const bool chaintip_loaded = m_snapshot_chainstate->LoadChainTip(::Params());
+    assert(chaintip_loaded);
+
+    m_active_chainstate = m_snapshot_chainstate.get();
+
+    LogPrintf("[snapshot] successfully activated snapshot %s\n", base_blockhash.ToString());
+
+    this->MaybeRebalanceCaches();
+    return true;
+}
+
+bool ChainstateManager::PopulateAndValidateSnapshot(
+    CChainState& snapshot_chainstate,
+    CAutoFile& coins_file,
+    const SnapshotMetadata& metadata)
+{
+    // It's okay to release cs_main before we're done using `coins_db` because we know
+    // that nothing else will be referencing the newly created snapshot_chainstate yet.
+    CCoinsViewDB& coins_db = *WITH_LOCK(::cs_main, return &snapshot_chainstate.CoinsDB());
+    const size_t batch_size_bytes = snapshot_chainstate.m_coinstip_cache_size_bytes;
+
+    uint256 base_blockhash = metadata.m_base_blockhash;
+
+    CBlockIndex* snapshot_start_block = WITH_LOCK(::cs_main, return LookupBlockIndex(base_blockhash));
+
+    if (!snapshot_start_block) {
+        // Needed for GetUTXOStats and ExpectedAssumeutxo to determine the height and to avoid a crash when base_blockhash.IsNull()
+        LogPrintf("[snapshot] Did not find snapshot start blockheader %s\n",
+                  base_blockhash.ToString());
+        return false;
+    }
+
+    int base_height = snapshot_start_block->nHeight;
+    auto maybe_au_data = ExpectedAssumeutxo(base_height, ::Params());
+
+    if (!maybe_au_data) {
+        LogPrintf("[snapshot] assumeutxo height in snapshot metadata not recognized " /* Continued */
+                  "(%d) - refusing to load snapshot\n", base_height);
+        return false;
+    }
+
+    const AssumeutxoData& au_data = *maybe_au_data;
+
+    // The coins are not held in the chainstate's cache while loading: they are
+    // collected in a separate map that is written to the coins database each
+    // time it reaches the size of the coins cache, so loading a snapshot needs
+    // a bounded amount of memory however many coins it holds. dumptxoutset
+    // writes the coins in database key order, so every batch covers its own
+    // key range and the writes only ever append.
+    //
+    // Until the last batch, the database is marked with a random best block.
+    // Should we crash halfway, the leftover database does not match any block
+    // and is wiped when the snapshot is loaded again.
+    const uint256 loading_marker = GetRandHash();
+    size_t batch_usage{0};
+
+    // Every batch gets a fresh pool, so the memory of a written batch is
+    // handed back at once and the usage of the next one starts from zero.
+    std::unique_ptr<CCoinsMapMemoryResource> batch_resource;
+    std::unique_ptr<CCoinsMap> batch_coins;
+    auto new_batch = [&] {
+        batch_coins.reset();
+        batch_resource.reset(new CCoinsMapMemoryResource());
+        batch_coins.reset(new CCoinsMap(0, SaltedOutpointHasher(), CCoinsMap::key_equal(), batch_resource.get()));
+        batch_usage = 0;
+    };
+    new_batch();
+
+    COutPoint outpoint;
+    Coin coin;
+    const uint64_t coins_count = metadata.m_coins_count;
+    uint64_t coins_left = metadata.m_coins_count;
+
+    LogPrintf("[snapshot] loading coins from snapshot %s\n", base_blockhash.ToString());
+    int64_t write_time{0};
+    int64_t coins_processed{0};
+
+    while (coins_left > 0) {
+        try {
+            coins_file >> outpoint;
+            coins_file >> coin;
+        } catch (const std::ios_base::failure&) {
+            LogPrintf("[snapshot] bad snapshot format or truncated snapshot after deserializing %d coins\n",
+                      coins_count - coins_left);
+            return false;
+        }
+        if (coin.nHeight > static_cast<uint32_t>(base_height) ||
+            outpoint.n >= std::numeric_limits<decltype(outpoint.n)>::max() // Avoid integer wrap-around in coinstats.cpp:ApplyHash
+        ) {
+            LogPrintf("[snapshot] bad snapshot data after deserializing %d coins\n",
+                      coins_count - coins_left);
+            return false;
+        }
+
+        batch_usage += coin.DynamicMemoryUsage();
+        CCoinsCacheEntry& entry = (*batch_coins)[outpoint];
+        entry.coin = std::move(coin);
+        entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+
+        --coins_left;
+        ++coins_processed;
+
+        if (coins_processed % 1000000 == 0) {
+            LogPrintf("[snapshot] %d coins loaded (%.2f%%, %.2f MB)\n",
+                coins_processed,
+                static_cast<float>(coins_processed) * 100 / static_cast<float>(coins_count),
+                (batch_usage + memusage::DynamicUsage(*batch_coins)) / (1000.0 * 1000));
+        }
+
+        // Batching memory usage checks every 1000 coins keeps the cost of the
+        // check off the hot path.
+        if (coins_processed % 1000 == 0 && batch_usage + memusage::DynamicUsage(*batch_coins) >= batch_size_bytes) {
+            if (ShutdownRequested()) {
+                LogPrintf("[snapshot] shutdown requested while loading the snapshot; aborting\n");
+                return false;
+            }
+            int64_t nStart = GetTimeMicros();
+            if (!coins_db.BatchWrite(*batch_coins, loading_marker)) {
+                LogPrintf("[snapshot] failed to write coins to the snapshot coins database\n");
+                return false;
+            }
+            assert(batch_coins->empty());
+            new_batch();
+            write_time += GetTimeMicros() - nStart;
+        }
+    }
+
+    bool out_of_coins{false};
+    try {
+        coins_file >> outpoint;
+    } catch (const std::ios_base::failure&) {
+        // We expect an exception since we should be out of coins.
+        out_of_coins = true;
+    }
+    if (!out_of_coins) {
+        LogPrintf("[snapshot] bad snapshot - coins left over after deserializing %d coins\n",
+            coins_count);
+        return false;
+    }
+
+    if (!coins_db.BatchWrite(*batch_coins, base_blockhash)) {
+        LogPrintf("[snapshot] failed to write coins to the snapshot coins database\n");
+        return false;
+    }
+    LogPrint(BCLog::BENCH, "[snapshot] loaded %d coins (%.2fms writing)\n",
+        coins_count, write_time / 1000.0);
+
+    // The in-memory cache is empty and only has to know its best block.
+    WITH_LOCK(::cs_main, snapshot_chainstate.CoinsTip().SetBestBlock(base_blockhash));
+
+    // The database no longer changes, so it's okay to hash it without cs_main.
+    CCoinsStats stats;
+    if (!GetUTXOStats(&coins_db, stats, CoinStatsHashType::HASH_SERIALIZED, [] {})) {
+        LogPrintf("[snapshot] failed to generate coins stats\n");
+        return false;
+    }
+
+    // Assert that the deserialized chainstate contents match the expected assumeutxo value.
+    if (stats.hashSerialized != au_data.hash_serialized) {
+        LogPrintf("[snapshot] bad snapshot content hash: expected %s, got %s\n",
+            au_data.hash_serialized.ToString(), stats.hashSerialized.ToString());
+        return false;
+    }
+
+    LOCK(::cs_main);
+
+    // Blocks below the snapshot base need not have been downloaded yet. Fake
+    // their nChainTx so they, and the snapshot base itself, can become the
+    // tip of the snapshot chainstate; nChainTx is not written to disk. The
+    // background chainstate only connects blocks it actually has data for,
+    // see AddBackgroundBlockIndexCandidates().
+    std::vector<CBlockIndex*> path;
+    for (CBlockIndex* index = snapshot_start_block; index; index = index->pprev) {
+        path.push_back(index);
+    }
+    for (auto it = path.rbegin(); it != path.rend(); ++it) {
+        CBlockIndex* index = *it;
+        if (!index->HaveTxsDownloaded()) {
+            index->nChainTx = (index->pprev ? index->pprev->nChainTx : 0) + std::max(index->nTx, 1u);
+        }
+    }
+    snapshot_start_block->nChainTx = au_data.nChainTx;
+
+    // Blocks on top of the snapshot base that were already downloaded were
+    // kept unlinked while the base was missing; link them now.
+    std::deque<CBlockIndex*> queue{snapshot_start_block};
+    while (!queue.empty()) {
+        CBlockIndex* pindex = queue.front();
+        queue.pop_front();
+        auto range = m_blockman.m_blocks_unlinked.equal_range(pindex);
+        while (range.first != range.second) {
+            CBlockIndex* child = range.first->second;
+            child->nChainTx = pindex->nChainTx + child->nTx;
+            {
+                LOCK(snapshot_chainstate.cs_nBlockSequenceId);
+                child->nSequenceId = snapshot_chainstate.nBlockSequenceId++;
+            }
+            snapshot_chainstate.setBlockIndexCandidates.insert(child);
+            queue.push_back(child);
+            range.first = m_blockman.m_blocks_unlinked.erase(range.first);
+        }
+    }
+    snapshot_chainstate.setBlockIndexCandidates.insert(snapshot_start_block);
+
+    LogPrintf("[snapshot] validated snapshot of %d coins at height %d\n", coins_count, base_height);
+    return true;
+}
+
+void ChainstateManager::AddBackgroundBlockIndexCandidates()
+{
+    CChain& background = m_ibd_chainstate->m_chain;
+    CBlockIndex* snapshot_base = LookupBlockIndex(m_snapshot_chainstate->m_from_snapshot_blockhash);
+    if (!snapshot_base || !background.Tip()) return;
+
+    // Faked nChainTx values make blocks below the snapshot base look
+    // connectable to FindMostWorkChain() without their data, so only offer
+    // the tip of the contiguous run of downloaded blocks.
+    CBlockIndex* candidate = nullptr;
+    for (int height = background.Height() + 1; height <= snapshot_base->nHeight; ++height) {
+        CBlockIndex* pindex = snapshot_base->GetAncestor(height);
+        if (!(pindex->nStatus & BLOCK_HAVE_DATA) || (pindex->nStatus & BLOCK_FAILED_MASK)) break;
+        candidate = pindex;
+    }
+    if (candidate) {
+        m_ibd_chainstate->setBlockIndexCandidates.insert(candidate);
+    }
+}
+
+bool ChainstateManager::ActivateBackgroundBestChain(const CChainParams& chainparams)
+{
+    CChainState* background;
+    {
+        LOCK(::cs_main);
+        if (!m_snapshot_chainstate || m_snapshot_validated || !m_ibd_chainstate) return true;
+        AddBackgroundBlockIndexCandidates();
+        background = m_ibd_chainstate.get();
+    }
+
+    BlockValidationState state;
+    if (!background->ActivateBestChain(state, chainparams, nullptr)) {
+        return false;
+    }
+
+    LOCK(::cs_main);
+    MaybeCompleteSnapshotValidation(chainparams);
+    return true;
+}
+
+void ChainstateManager::MaybeCompleteSnapshotValidation(const CChainParams& chainparams)
+{
+    if (!m_snapshot_chainstate || m_snapshot_validated || !m_ibd_chainstate) return;
+
+    const CBlockIndex* background_tip = m_ibd_chainstate->m_chain.Tip();
+    if (!background_tip || background_tip->GetBlockHash() != m_snapshot_chainstate->m_from_snapshot_blockhash) return;
+
+    const AssumeutxoData* au_data = ExpectedAssumeutxo(background_tip->nHeight, chainparams);
+    assert(au_data);
+
+    m_ibd_chainstate->ForceFlushStateToDisk();
+    CCoinsStats stats;
+    if (!GetUTXOStats(&m_ibd_chainstate->CoinsDB(), stats, CoinStatsHashType::HASH_SERIALIZED, [] {})) {
+        AbortNode("Failed to hash the UTXO set of the background chainstate");
+        return;
+    }
+    if (stats.hashSerialized != au_data->hash_serialized) {
+        LogPrintf("[snapshot] background validation of snapshot %s failed: expected %s, got %s\n",
+            background_tip->GetBlockHash().ToString(), au_data->hash_serialized.ToString(), stats.hashSerialized.ToString());
+        AbortNode("The UTXO snapshot in use does not match the validated chain");
+        return;
+    }
+
+    LogPrintf("[snapshot] snapshot %s validated by the background chainstate\n", background_tip->GetBlockHash().ToString());
+    m_snapshot_validated = true;
+    MaybeRebalanceCaches();
+}
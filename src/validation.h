@@ -35,17 +35,21 @@
 
 class CChainState;
 class BlockValidationState;
+class CAutoFile;
 class CBlockIndex;
 class CBlockTreeDB;
 class CBlockUndo;
 class CChainParams;
 class CInv;
 class CConnman;
+class BatchSchnorrVerifier;
 class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
 class ChainstateManager;
+class SnapshotMetadata;
 class TxValidationState;
+struct AssumeutxoData;
 struct ChainTxData;
 
 struct DisconnectedBlockTransactions;
@@ -66,15 +70,27 @@ static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 336;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
+/** Maximum number of block files kept memory-mapped for serving blocks to peers */
+static const size_t MAX_MAPPED_BLOCK_FILES = 64;
 /** Maximum number of dedicated script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 15;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of dedicated input-prefetch threads allowed */
+static const int MAX_INPUTFETCH_THREADS = 16;
+/** -inputfetchthreads default (number of threads prefetching block inputs from the chainstate database, 0 = disabled) */
+static const int DEFAULT_INPUTFETCH_THREADS = 4;
+/** Maximum number of threads scanning block files ahead of the one being reindexed */
+static const int MAX_BLOCKFILE_SCAN_THREADS = 16;
+/** Serialized size of the scanned blocks of a block file that may wait to be accepted */
+static const size_t BLOCKFILE_SCAN_BUFFER_BYTES = 32 << 20;
 /*static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;*/
 static const int64_t DEFAULT_MAX_TIP_AGE = 10 * 24 * 60 * 60;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;//true;//false;
 static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
+/** Default for -deferundodepth (0 = always write undo data) */
+static const int64_t DEFAULT_DEFER_UNDO_DEPTH = 0;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** Default for using fee filter */
@@ -122,9 +138,19 @@ extern std::atomic_bool fReindex;
  * False indicates all script checking is done on the main threadMessageHandler thread.
  */
 extern bool g_parallel_script_checks;
+/** Whether there are dedicated input-prefetch threads running.
+ * False indicates block inputs are read from the chainstate database on demand while connecting.
+ */
+extern bool g_parallel_input_fetch;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/**
+ * Blocks connected more than this many blocks below the best header get no
+ * undo data written (-deferundodepth, 0 = disabled). UndoReadFromDisk()
+ * rebuilds it when it is needed.
+ */
+extern int64_t g_defer_undo_depth;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
 /** If the tip is older than this (in seconds), the node is considered to be in initial block download. */
@@ -155,12 +181,22 @@ FILE* OpenBlockFile(const FlatFilePos &pos, bool fReadOnly = false);
 fs::path GetBlockPosFilename(const FlatFilePos &pos);
 /** Import blocks from an external file */
 void LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, FlatFilePos* dbp = nullptr);
+/**
+ * Import the blocks of all blk files, in file order (-reindex). The files are
+ * scanned and their blocks checked on several threads, ahead of the file
+ * whose blocks are being accepted.
+ */
+void ReindexBlockFiles(const CChainParams& chainparams);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Unload database information */
 void UnloadBlockIndex(CTxMemPool* mempool, ChainstateManager& chainman);
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck(int worker_num);
+/** Run an instance of the input prefetching thread */
+void ThreadInputFetch(int worker_num);
+/** Run the thread reading ahead the next block to be connected */
+void ThreadBlockReadAhead();
 /**
  * Return transaction from the block at block_index.
  * If block_index is not provided, fall back to mempool.
@@ -267,6 +303,11 @@ public:
         m_tx_out(outIn), ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR), txdata(txdataIn) { }
 
     bool operator()();
+    /** Run the check, adding the Schnorr signatures it would verify (unless
+     *  they are in the signature cache) to batch instead. The check only holds
+     *  if the batch verifies too. Signatures are not batched if cacheStore is
+     *  set, as they would have to be stored in the cache before verifying. */
+    bool operator()(BatchSchnorrVerifier* batch);
 
     void swap(CScriptCheck &check) {
         std::swap(ptxTo, check.ptxTo);
@@ -281,6 +322,40 @@ public:
     ScriptError GetScriptError() const { return error; }
 };
 
+template <typename T>
+bool RunChecks(std::vector<T>& checks);
+/** Verify the Schnorr signatures of a group of script checks in one batch. If
+ *  the batch fails, the checks are run again one at a time, so that the
+ *  failing one reports its script error. */
+template <>
+bool RunChecks(std::vector<CScriptCheck>& checks);
+
+/**
+ * Closure representing one prevout lookup in the coins database, used to
+ * warm the coins cache before a block is connected.
+ * Note that this stores references to the view and the result slot
+ */
+class CInputFetch
+{
+private:
+    const CCoinsView* m_view;
+    COutPoint m_outpoint;
+    Coin* m_coin;
+
+public:
+    CInputFetch(): m_view(nullptr), m_coin(nullptr) {}
+    CInputFetch(const CCoinsView& viewIn, const COutPoint& outpointIn, Coin& coinOut) :
+        m_view(&viewIn), m_outpoint(outpointIn), m_coin(&coinOut) { }
+
+    bool operator()();
+
+    void swap(CInputFetch &check) {
+        std::swap(m_view, check.m_view);
+        std::swap(m_outpoint, check.m_outpoint);
+        std::swap(m_coin, check.m_coin);
+    }
+};
+
 /** Initializes the script-execution cache */
 void InitScriptExecutionCache();
 
@@ -290,7 +365,18 @@ bool ReadBlockFromDisk(CBlock& block, const FlatFilePos& pos, const Consensus::P
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
 bool ReadRawBlockFromDisk(std::vector<uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
+/**
+ * Get the serialized block at pos as a view into a shared read-only mapping of its block file,
+ * without copying it. owner keeps the mapping alive for as long as the view is used.
+ * Returns false if the block could not be mapped, in which case ReadRawBlockFromDisk can be used instead.
+ */
+bool MapRawBlockFromDisk(std::shared_ptr<const void>& owner, Span<const uint8_t>& block, const FlatFilePos& pos, const CMessageHeader::MessageStartChars& message_start);
+bool MapRawBlockFromDisk(std::shared_ptr<const void>& owner, Span<const uint8_t>& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
+/**
+ * Read the undo data of a block. The undo data of a block connected with
+ * -deferundodepth is rebuilt from the blocks before it and written to disk.
+ */
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
@@ -378,6 +464,22 @@ private:
      */
     void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight, int chain_tip_height, bool is_ibd);
 
+    /** Number of entries of m_block_index allocated at once. */
+    static constexpr size_t BLOCK_INDEX_CHUNK_SIZE{4096};
+
+    /**
+     * Storage of the entries of m_block_index. They are allocated in chunks
+     * rather than one by one, which saves the allocator overhead of every
+     * entry and keeps them close together in memory. Entries never move and
+     * are only released all at once, by Unload().
+     */
+    std::vector<std::unique_ptr<CBlockIndex[]>> m_block_index_chunks GUARDED_BY(cs_main);
+    //! Number of entries handed out from the last chunk.
+    size_t m_block_index_chunk_used GUARDED_BY(cs_main){BLOCK_INDEX_CHUNK_SIZE};
+
+    /** Get a blank entry for m_block_index. */
+    CBlockIndex* NewBlockIndex() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 public:
     BlockMap m_block_index GUARDED_BY(cs_main);
 
@@ -465,6 +567,10 @@ public:
     //! This view wraps access to the leveldb instance and handles read errors gracefully.
     CCoinsViewErrorCatcher m_catcherview GUARDED_BY(cs_main);
 
+    //! This view writes the coins cache to the leveldb instance in the background when
+    //! the cache is synced to disk without being emptied.
+    CCoinsViewAsyncWriter m_writerview;
+
     //! This is the top layer of the cache hierarchy - it keeps as many coins in memory as
     //! can fit per the dbcache setting.
     std::unique_ptr<CCoinsViewCache> m_cacheview GUARDED_BY(cs_main);
@@ -630,6 +736,11 @@ public:
      * If FlushStateMode::NONE is used, then FlushStateToDisk(...) won't do anything
      * besides checking if we need to prune.
      *
+     * Only FlushStateMode::ALWAYS empties the coins cache, and waits for the
+     * coins to be on disk. Otherwise the coins stay cached and are written in
+     * the background, and if the cache is too large, just enough cold coins
+     * are evicted to make room.
+     *
      * @returns true unless a system error occurred
      */
     bool FlushStateToDisk(
@@ -720,6 +831,8 @@ public:
 private:
     bool ActivateBestChainStep(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexMostWork, const std::shared_ptr<const CBlock>& pblock, bool& fInvalidFound, ConnectTrace& connectTrace) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs);
     bool ConnectTip(BlockValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace, DisconnectedBlockTransactions& disconnectpool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, m_mempool.cs);
+    /** Warm CoinsTip() with a block's prevouts, reading them from the database on the input-prefetch threads. */
+    void PrefetchBlockInputs(const std::vector<COutPoint>& prevouts) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     void InvalidBlockFound(CBlockIndex *pindex, const BlockValidationState &state) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     CBlockIndex* FindMostWorkChain() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -831,6 +944,23 @@ private:
     //! by the background validation chainstate.
     bool m_snapshot_validated{false};
 
+    //! Internal helper for ActivateSnapshot(): stream the coins of the snapshot
+    //! into the (empty) coins database of snapshot_chainstate, check the result
+    //! against the assumeutxo parameters and set up its chain.
+    bool PopulateAndValidateSnapshot(
+        CChainState& snapshot_chainstate,
+        CAutoFile& coins_file,
+        const SnapshotMetadata& metadata);
+
+    //! Make the background chainstate aware of newly downloaded blocks
+    //! leading up to the snapshot base block.
+    void AddBackgroundBlockIndexCandidates() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
+    //! Once the background chainstate has reached the snapshot base block,
+    //! check that its UTXO set hashes to what the snapshot was accepted for
+    //! and mark the snapshot validated.
+    void MaybeCompleteSnapshotValidation(const CChainParams& chainparams) EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
+
     // For access to m_active_chainstate.
     friend CChainState& ChainstateActive();
     friend CChain& ChainActive();
@@ -861,6 +991,24 @@ public:
     //! Get all chainstates currently being used.
     std::vector<CChainState*> GetAll();
 
+    //! Construct and activate a chainstate on the basis of a UTXO snapshot
+    //! whose base block header is known and whose contents match the
+    //! assumeutxo parameters. The current chainstate is kept to validate the
+    //! blocks up to the snapshot base in the background.
+    //!
+    //! The coins are streamed into the new coins database in batches bounded
+    //! by the coins cache size, so memory use does not grow with the snapshot.
+    //!
+    //! @param[in] coins_file   The snapshot file, positioned after the metadata
+    //! @param[in] metadata     The metadata read from the start of the file
+    //! @param[in] in_memory    Keep the coins database in memory (for tests)
+    //! @returns false if the snapshot could not be loaded or failed validation
+    bool ActivateSnapshot(CAutoFile& coins_file, const SnapshotMetadata& metadata, bool in_memory);
+
+    //! While a snapshot is being validated, connect the blocks that are
+    //! available to the background chainstate.
+    bool ActivateBackgroundBestChain(const CChainParams& chainparams) LOCKS_EXCLUDED(::cs_main);
+
     //! The most-work chain.
     CChainState& ActiveChainstate() const;
     CChain& ActiveChain() const { return ActiveChainstate().m_chain; }
@@ -941,6 +1089,12 @@ public:
     void MaybeRebalanceCaches() EXCLUSIVE_LOCKS_REQUIRED(::cs_main);
 };
 
+/**
+ * Return the assumeutxo parameters for a snapshot based on the block at the
+ * given height, or nullptr if the chain parameters do not allow one there.
+ */
+const AssumeutxoData* ExpectedAssumeutxo(int height, const CChainParams& params);
+
 /** DEPRECATED! Please use node.chainman instead. May only be used in validation.cpp internally */
 extern ChainstateManager g_chainman GUARDED_BY(::cs_main);
 
@@ -976,6 +1130,14 @@ bool DumpMempool(const CTxMemPool& pool);
 /** Load the mempool from disk. */
 bool LoadMempool(CTxMemPool& pool);
 
+/** Dump the salts and the entries of the signature cache and the script
+ *  execution cache to disk. Entries used by block validation are left out, so
+ *  this is mostly what the mempool transactions put in. */
+bool DumpScriptCaches();
+
+/** Load the script caches from disk. Must be called before they are used. */
+bool LoadScriptCaches();
+
 //! Check whether the block associated with this index entry is pruned or not.
 inline bool IsBlockPruned(const CBlockIndex* pblockindex)
 {
@@ -614,7 +614,10 @@ public:
     void WriteDescriptor();
 
     const WalletDescriptor GetWalletDescriptor() const EXCLUSIVE_LOCKS_REQUIRED(cs_desc_man);
-    const std::vector<CScript> GetScriptPubKeys() const;
+    //! The scriptPubKeys of the descriptor, from the given range index on
+    const std::vector<CScript> GetScriptPubKeys(int32_t minimum_index = 0) const;
+    //! One past the highest range index whose scriptPubKeys are known
+    int32_t GetEndRange() const;
 };
 
 #endif // BITCOIN_WALLET_SCRIPTPUBKEYMAN_H
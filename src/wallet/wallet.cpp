@@ -5,6 +5,7 @@
 
 #include <wallet/wallet.h>
 
+#include <blockfilter.h>
 #include <chain.h>
 #include <consensus/consensus.h>
 #include <consensus/validation.h>
@@ -37,6 +38,9 @@
 
 #include <algorithm>
 #include <assert.h>
+#include <condition_variable>
+#include <deque>
+#include <thread>
 
 #include <boost/algorithm/string/replace.hpp>
 
@@ -1715,6 +1719,215 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
     return startTime;
 }
 
+namespace {
+/** Maximum number of threads fetching blocks ahead of a rescan. */
+constexpr int MAX_RESCAN_THREADS{8};
+/** Number of blocks fetched ahead of the one being scanned, per fetching thread. */
+constexpr int RESCAN_BLOCKS_AHEAD_PER_THREAD{4};
+
+/**
+ * Matches blocks against the scriptPubKeys of a descriptor wallet with their
+ * BIP 157 basic block filter. A block can only involve the wallet if it pays
+ * to or spends from one of them, and the filter covers both. The set grows
+ * when the descriptors are topped up during the rescan; every change makes a
+ * new generation of it, so results obtained with an older one can be told apart.
+ */
+class FastWalletRescanFilter
+{
+public:
+    explicit FastWalletRescanFilter(const CWallet& wallet) : m_wallet(wallet)
+    {
+        // Only descriptor wallets know all the scriptPubKeys they can be involved with.
+        assert(!m_wallet.IsLegacy());
+        UpdateIfNeeded();
+    }
+
+    /** Add the scriptPubKeys the descriptors got since the last update. */
+    void UpdateIfNeeded()
+    {
+        std::shared_ptr<GCSFilter::ElementSet> elements;
+        for (ScriptPubKeyMan* spk_man : WITH_LOCK(m_wallet.cs_wallet, return m_wallet.GetAllScriptPubKeyMans())) {
+            auto desc_spk_man = dynamic_cast<DescriptorScriptPubKeyMan*>(spk_man);
+            assert(desc_spk_man != nullptr);
+            int32_t& range_end = m_range_ends[desc_spk_man->GetID()];
+            const int32_t new_range_end = desc_spk_man->GetEndRange();
+            if (new_range_end <= range_end) continue;
+            if (!elements) elements = std::make_shared<GCSFilter::ElementSet>(*WITH_LOCK(m_mutex, return m_elements));
+            for (const CScript& script_pub_key : desc_spk_man->GetScriptPubKeys(range_end)) {
+                elements->emplace(script_pub_key.begin(), script_pub_key.end());
+            }
+            range_end = new_range_end;
+        }
+        if (elements) {
+            LOCK(m_mutex);
+            m_elements = std::move(elements);
+            ++m_generation;
+        }
+    }
+
+    uint64_t GetGeneration() const { return WITH_LOCK(m_mutex, return m_generation); }
+
+    /** Check a block against the current set. Returns nullopt if its filter is not available. */
+    Optional<bool> MatchesBlock(interfaces::Chain& chain, const uint256& block_hash, uint64_t& generation) const
+    {
+        std::shared_ptr<const GCSFilter::ElementSet> elements;
+        {
+            LOCK(m_mutex);
+            elements = m_elements;
+            generation = m_generation;
+        }
+        return chain.blockFilterMatchesAny(BlockFilterType::BASIC, block_hash, *elements);
+    }
+
+private:
+    const CWallet& m_wallet;
+    /** One past the last range index of each descriptor whose scriptPubKeys are in the set. */
+    std::map<uint256, int32_t> m_range_ends;
+    mutable Mutex m_mutex;
+    /** The set is replaced rather than modified, so matching can go on while it is updated. */
+    std::shared_ptr<const GCSFilter::ElementSet> m_elements GUARDED_BY(m_mutex){std::make_shared<GCSFilter::ElementSet>()};
+    uint64_t m_generation GUARDED_BY(m_mutex){0};
+};
+
+/**
+ * Fetches the blocks a rescan is about to reach on a pool of threads, checking
+ * them against the wallet's block filter first if it has one, so reading and
+ * deserializing the blocks overlaps with adding their transactions. The rescan
+ * takes the blocks back in chain order and adds the transactions on its own
+ * thread, as before.
+ */
+class RescanBlockFetcher
+{
+public:
+    struct Result {
+        //! Whether the block filter was found, with which generation of the filter set it was checked, and whether it matched
+        bool filter_checked{false};
+        uint64_t filter_generation{0};
+        bool filter_matched{false};
+        //! Whether the block was found; block is null if it could not be read
+        bool found{false};
+        CBlock block;
+    };
+
+    RescanBlockFetcher(interfaces::Chain& chain, const FastWalletRescanFilter* filter, int num_threads)
+        : m_chain(chain), m_filter(filter)
+    {
+        for (int i = 0; i < num_threads; ++i) {
+            m_threads.emplace_back(&TraceThread<std::function<void()>>, "rescan", [this] { ThreadFetch(); });
+        }
+    }
+
+    ~RescanBlockFetcher()
+    {
+        WITH_LOCK(m_mutex, m_stop = true);
+        m_cond_work.notify_all();
+        for (std::thread& thread : m_threads) thread.join();
+    }
+
+    size_t Pending() const { return WITH_LOCK(m_mutex, return m_jobs.size()); }
+
+    /** The last queued block, if any. */
+    bool Back(uint256& block_hash, int& block_height) const
+    {
+        LOCK(m_mutex);
+        if (m_jobs.empty()) return false;
+        block_hash = m_jobs.back()->block_hash;
+        block_height = m_jobs.back()->block_height;
+        return true;
+    }
+
+    void Push(const uint256& block_hash, int block_height)
+    {
+        auto job = std::make_shared<Job>();
+        job->block_hash = block_hash;
+        job->block_height = block_height;
+        WITH_LOCK(m_mutex, m_jobs.push_back(std::move(job)));
+        m_cond_work.notify_one();
+    }
+
+    /**
+     * Take the oldest queued block, waiting for it to be fetched. If another
+     * block was queued first, after a reorg, the queue is emptied and the
+     * block fetched on the calling thread.
+     */
+    Result Pop(const uint256& block_hash, int block_height)
+    {
+        WAIT_LOCK(m_mutex, lock);
+        if (m_jobs.empty() || m_jobs.front()->block_hash != block_hash || m_jobs.front()->block_height != block_height) {
+            // Jobs in progress keep their own reference and are discarded when done.
+            m_jobs.clear();
+            m_next_job = 0;
+            REVERSE_LOCK(lock);
+            Result result;
+            Fetch(block_hash, result);
+            return result;
+        }
+        std::shared_ptr<Job> job = m_jobs.front();
+        if (m_next_job == 0) {
+            // Nobody took it yet, so fetch it here rather than wait.
+            m_jobs.pop_front();
+            REVERSE_LOCK(lock);
+            Fetch(job->block_hash, job->result);
+            return std::move(job->result);
+        }
+        m_cond_done.wait(lock, [&] { return job->done; });
+        m_jobs.pop_front();
+        --m_next_job;
+        return std::move(job->result);
+    }
+
+    /** Fetch a block, checking the filter first if there is one. */
+    void Fetch(const uint256& block_hash, Result& result) const
+    {
+        if (m_filter) {
+            const Optional<bool> matches = m_filter->MatchesBlock(m_chain, block_hash, result.filter_generation);
+            if (matches) {
+                result.filter_checked = true;
+                result.filter_matched = *matches;
+                if (!*matches) return;
+            }
+        }
+        result.found = m_chain.findBlock(block_hash, FoundBlock().data(result.block));
+    }
+
+private:
+    struct Job {
+        uint256 block_hash;
+        int block_height;
+        bool done{false};
+        Result result;
+    };
+
+    interfaces::Chain& m_chain;
+    const FastWalletRescanFilter* const m_filter;
+    std::vector<std::thread> m_threads;
+
+    mutable Mutex m_mutex;
+    std::condition_variable m_cond_work;
+    std::condition_variable m_cond_done;
+    std::deque<std::shared_ptr<Job>> m_jobs GUARDED_BY(m_mutex);
+    /** Index of the first job in m_jobs no thread has taken. */
+    size_t m_next_job GUARDED_BY(m_mutex){0};
+    bool m_stop GUARDED_BY(m_mutex){false};
+
+    void ThreadFetch()
+    {
+        WAIT_LOCK(m_mutex, lock);
+        while (true) {
+            m_cond_work.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) { return m_stop || m_next_job < m_jobs.size(); });
+            if (m_stop) return;
+            std::shared_ptr<Job> job = m_jobs[m_next_job++];
+            {
+                REVERSE_LOCK(lock);
+                Fetch(job->block_hash, job->result);
+            }
+            job->done = true;
+            m_cond_done.notify_all();
+        }
+    }
+};
+} // namespace
+
 /**
  * Scan the block chain (starting in start_block) for transactions
  * from or to us. If fUpdate is true, found transactions that already
@@ -1735,6 +1948,10 @@ int64_t CWallet::RescanFromTime(int64_t startTime, const WalletRescanReserver& r
  * @pre Caller needs to make sure start_block (and the optional stop_block) are on
  * the main chain after to the addition of any new keys you want to detect
  * transactions for.
+ *
+ * Blocks are read ahead of the scan on several threads. With a basic block
+ * filter index, descriptor wallets only read the blocks whose filter matches
+ * one of their scriptPubKeys.
  */
 CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_block, int start_height, Optional<int> max_height, const WalletRescanReserver& reserver, bool fUpdate)
 {
@@ -1757,6 +1974,16 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
     double progress_end = chain().guessVerificationProgress(end_hash);
     double progress_current = progress_begin;
     int block_height = start_height;
+
+    std::unique_ptr<FastWalletRescanFilter> fast_rescan_filter;
+    if (!IsLegacy() && chain().hasBlockFilterIndex(BlockFilterType::BASIC)) {
+        fast_rescan_filter = MakeUnique<FastWalletRescanFilter>(*this);
+    }
+    const int fetch_threads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS));
+    RescanBlockFetcher fetcher(chain(), fast_rescan_filter.get(), fetch_threads);
+    int blocks_scanned = 0;
+    int blocks_skipped = 0;
+
     while (!fAbortRescan && !chain().shutdownRequested()) {
         if (progress_end - progress_begin > 0.0) {
             m_scanning_progress = (progress_current - progress_begin) / (progress_end - progress_begin);
@@ -1771,11 +1998,50 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
             WalletLogPrintf("Still rescanning. At block %d. Progress=%f\n", block_height, progress_current);
         }
 
-        CBlock block;
+        // Queue the blocks following this one, as far as the active chain goes.
+        // A reorg is noticed below, as without fetching ahead.
+        uint256 ahead_hash = block_hash;
+        int ahead_height = block_height;
+        if (!fetcher.Back(ahead_hash, ahead_height)) fetcher.Push(block_hash, block_height);
+        while (fetcher.Pending() < (size_t)(fetch_threads * RESCAN_BLOCKS_AHEAD_PER_THREAD) && (!max_height || ahead_height < *max_height)) {
+            uint256 next_hash;
+            if (!chain().findNextBlock(ahead_hash, ahead_height, FoundBlock().hash(next_hash))) break;
+            ahead_hash = next_hash;
+            fetcher.Push(ahead_hash, ++ahead_height);
+        }
+        RescanBlockFetcher::Result fetched = fetcher.Pop(block_hash, block_height);
+
+        bool skip_block = false;
+        if (fetched.filter_checked && !fetched.filter_matched) {
+            // The wallet may have got new scriptPubKeys from the blocks scanned
+            // since the filter was checked. Check it again with them.
+            fast_rescan_filter->UpdateIfNeeded();
+            if (fetched.filter_generation == fast_rescan_filter->GetGeneration()) {
+                skip_block = true;
+            } else {
+                fetched = RescanBlockFetcher::Result{};
+                fetcher.Fetch(block_hash, fetched);
+                skip_block = fetched.filter_checked && !fetched.filter_matched;
+            }
+        }
+
+        const CBlock& block = fetched.block;
         bool next_block;
         uint256 next_block_hash;
         bool reorg = false;
-        if (chain().findBlock(block_hash, FoundBlock().data(block)) && !block.IsNull()) {
+        if (skip_block) {
+            LOCK(cs_wallet);
+            next_block = chain().findNextBlock(block_hash, block_height, FoundBlock().hash(next_block_hash), &reorg);
+            if (reorg) {
+                result.last_failed_block = block_hash;
+                result.status = ScanResult::FAILURE;
+                break;
+            }
+            // The block cannot involve the wallet, so it counts as scanned.
+            ++blocks_skipped;
+            result.last_scanned_block = block_hash;
+            result.last_scanned_height = block_height;
+        } else if (fetched.found && !block.IsNull()) {
             LOCK(cs_wallet);
             next_block = chain().findNextBlock(block_hash, block_height, FoundBlock().hash(next_block_hash), &reorg);
             if (reorg) {
@@ -1791,6 +2057,7 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
                 SyncTransaction(block.vtx[posInBlock], {CWalletTx::Status::CONFIRMED, block_height, block_hash, (int)posInBlock}, fUpdate);
             }
             // scan succeeded, record block as most recent successfully scanned
+            ++blocks_scanned;
             result.last_scanned_block = block_hash;
             result.last_scanned_height = block_height;
         } else {
@@ -1833,6 +2100,9 @@ CWallet::ScanResult CWallet::ScanForWalletTransactions(const uint256& start_bloc
     } else {
         WalletLogPrintf("Rescan completed in %15dms\n", GetTimeMillis() - start_time);
     }
+    if (fast_rescan_filter) {
+        WalletLogPrintf("Rescan read %d blocks, and skipped %d whose block filter did not match the wallet\n", blocks_scanned, blocks_skipped);
+    }
     return result;
 }
 
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Rwa Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test -coinstatsindex.
+
+A node with the coin stats index answers gettxoutsetinfo from it, for the tip
+and for earlier blocks, with the same MuHash and totals as a scan of the UTXO
+set. The index follows reorganizations and is kept across restarts.
+"""
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+)
+from test_framework.wallet import MiniWallet
+
+INDEXED_KEYS = ['height', 'bestblock', 'txouts', 'bogosize', 'total_amount']
+
+
+class CoinStatsIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], ['-coinstatsindex']]
+
+    def mine(self, node):
+        return node.generatetoaddress(1, ADDRESS_BCRT1_P2WSH_OP_TRUE, 100000000)[0]
+
+    def sync_index(self, node):
+        height = node.getblockcount()
+        self.wait_until(lambda: node.getindexinfo('coinstatsindex') == {'coinstatsindex': {'synced': True, 'best_block_height': height}})
+
+    def check_index_matches_scan(self, node):
+        for hash_type in ['muhash', 'none']:
+            indexed = node.gettxoutsetinfo(hash_type)
+            scanned = node.gettxoutsetinfo(hash_type, use_index=False)
+            assert 'transactions' not in indexed and 'disk_size' not in indexed
+            assert 'transactions' in scanned and 'disk_size' in scanned
+            for key in INDEXED_KEYS + (['muhash'] if hash_type == 'muhash' else []):
+                assert_equal(indexed[key], scanned[key])
+
+    def run_test(self):
+        node, index_node = self.nodes
+        wallet = MiniWallet(node)
+
+        self.log.info("Mine a chain spending coinbases and coins of the block before")
+        coinbases = []
+        for _ in range(105):
+            block = node.getblock(self.mine(node), 2)
+            coinbases.append({'txid': block['tx'][0]['txid'], 'vout': 0, 'value': block['tx'][0]['vout'][0]['value']})
+        for coinbase in coinbases[:5]:
+            wallet.send_self_transfer(from_node=node, utxo_to_spend=coinbase)
+            self.mine(node)
+        for _ in range(5):
+            wallet.send_self_transfer(from_node=node)
+            wallet.send_self_transfer(from_node=node)
+            self.mine(node)
+        self.sync_blocks()
+        self.sync_index(index_node)
+
+        self.log.info("The index answers for the tip like a scan of the UTXO set")
+        self.check_index_matches_scan(index_node)
+        assert_equal(index_node.gettxoutsetinfo('muhash')['muhash'], node.gettxoutsetinfo('muhash')['muhash'])
+        assert_equal(index_node.gettxoutsetinfo()['hash_serialized_2'], node.gettxoutsetinfo()['hash_serialized_2'])
+
+        self.log.info("The index answers for earlier blocks")
+        height = index_node.getblockcount()
+        earlier = index_node.gettxoutsetinfo('muhash')
+        for _ in range(3):
+            wallet.send_self_transfer(from_node=node)
+            self.mine(node)
+        self.sync_blocks()
+        self.sync_index(index_node)
+        assert_equal(index_node.gettxoutsetinfo('muhash', height), earlier)
+        assert_equal(index_node.gettxoutsetinfo('muhash', earlier['bestblock']), earlier)
+        assert index_node.gettxoutsetinfo('muhash')['muhash'] != earlier['muhash']
+        genesis = index_node.gettxoutsetinfo('none', 0)
+        assert_equal(genesis['txouts'], 0)
+        assert_equal(genesis['total_amount'], 0)
+
+        assert_raises_rpc_error(-8, "Querying specific block heights requires coinstatsindex", node.gettxoutsetinfo, 'muhash', height)
+        assert_raises_rpc_error(-8, "hash_serialized_2 hash type cannot be queried for a specific block", index_node.gettxoutsetinfo, 'hash_serialized_2', height)
+        assert_raises_rpc_error(-8, "Cannot set use_index to false when querying for a specific block", index_node.gettxoutsetinfo, 'muhash', height, False)
+        assert_raises_rpc_error(-8, "Target block height {} after current tip".format(height + 10), index_node.gettxoutsetinfo, 'muhash', height + 10)
+
+        self.log.info("The index follows a reorganization")
+        self.disconnect_nodes(0, 1)
+        tip = index_node.getbestblockhash()
+        tip_stats = index_node.gettxoutsetinfo('muhash')
+        index_node.invalidateblock(index_node.getblockhash(height + 2))
+        for _ in range(3):
+            self.mine(index_node)
+        self.sync_index(index_node)
+        self.check_index_matches_scan(index_node)
+        assert_raises_rpc_error(-8, "Block is not in chain", index_node.gettxoutsetinfo, 'muhash', tip)
+        index_node.reconsiderblock(index_node.getblockhash(height + 2))
+        index_node.invalidateblock(index_node.getblockhash(height + 1))
+        index_node.reconsiderblock(tip)
+        assert_equal(index_node.getbestblockhash(), tip)
+        self.sync_index(index_node)
+        assert_equal(index_node.gettxoutsetinfo('muhash'), tip_stats)
+
+        self.log.info("The index is kept across restarts")
+        self.restart_node(1, extra_args=['-coinstatsindex'])
+        self.sync_index(index_node)
+        assert_equal(index_node.gettxoutsetinfo('muhash'), tip_stats)
+        self.connect_nodes(0, 1)
+        wallet.send_self_transfer(from_node=node)
+        self.mine(node)
+        self.sync_blocks()
+        self.sync_index(index_node)
+        self.check_index_matches_scan(index_node)
+
+
+if __name__ == '__main__':
+    CoinStatsIndexTest().main()
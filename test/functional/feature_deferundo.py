@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Rwa Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test -deferundodepth.
+
+A node syncing with -deferundodepth does not write the undo data of blocks
+far below the best header. Reading it (getblockstats, disconnecting the
+blocks) rebuilds it from the earlier blocks.
+"""
+from test_framework.address import ADDRESS_BCRT1_P2WSH_OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+from test_framework.wallet import MiniWallet
+
+DEFER_UNDO_DEPTH = 288
+
+
+class DeferUndoTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [[], ['-deferundodepth={}'.format(DEFER_UNDO_DEPTH)]]
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def mine(self, node):
+        return node.generatetoaddress(1, ADDRESS_BCRT1_P2WSH_OP_TRUE, 100000000)[0]
+
+    def run_test(self):
+        node, deferring = self.nodes
+        wallet = MiniWallet(node)
+
+        self.log.info("Mine a chain spending old coinbases and coins of the block before")
+        coinbases = []
+        for _ in range(110):
+            block = node.getblock(self.mine(node), 2)
+            coinbases.append({'txid': block['tx'][0]['txid'], 'vout': 0, 'value': block['tx'][0]['vout'][0]['value']})
+        for coinbase in coinbases[:10]:
+            wallet.send_self_transfer(from_node=node, utxo_to_spend=coinbase)
+            self.mine(node)
+        for _ in range(DEFER_UNDO_DEPTH + 20):
+            wallet.send_self_transfer(from_node=node)
+            wallet.send_self_transfer(from_node=node)
+            self.mine(node)
+        tip_height = node.getblockcount()
+
+        self.log.info("Sync a node deferring undo writes")
+        self.connect_nodes(0, 1)
+        self.sync_blocks()
+
+        self.log.info("Undo data of deferred blocks is rebuilt when read, once")
+        deep_height = tip_height - DEFER_UNDO_DEPTH - 1
+        for height in range(105, 115):
+            with deferring.assert_debug_log(expected_msgs=['Rebuilt undo data of block {}'.format(node.getblockhash(height))]):
+                assert_equal(deferring.getblockstats(height), node.getblockstats(height))
+        with deferring.assert_debug_log(expected_msgs=[], unexpected_msgs=['Rebuilt undo data']):
+            assert_equal(deferring.getblockstats(110), node.getblockstats(110))
+            assert_equal(deferring.getblockstats(deep_height + 2), node.getblockstats(deep_height + 2))
+
+        self.log.info("Blocks whose undo data was deferred can be disconnected")
+        self.disconnect_nodes(0, 1)
+        fork_hash = node.getblockhash(115)
+        deep_hash = node.getblockhash(deep_height)
+        node.invalidateblock(fork_hash)
+        with deferring.assert_debug_log(expected_msgs=['Rebuilt undo data of block {}'.format(deep_hash)]):
+            deferring.invalidateblock(fork_hash)
+        assert_equal(deferring.getbestblockhash(), node.getbestblockhash())
+        assert_equal(deferring.gettxoutsetinfo()['hash_serialized_2'], node.gettxoutsetinfo()['hash_serialized_2'])
+        for n in self.nodes:
+            n.reconsiderblock(fork_hash)
+        assert_equal(deferring.getblockcount(), tip_height)
+        assert_equal(deferring.gettxoutsetinfo()['hash_serialized_2'], node.gettxoutsetinfo()['hash_serialized_2'])
+
+
+if __name__ == '__main__':
+    DeferUndoTest().main()
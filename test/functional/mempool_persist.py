@@ -17,8 +17,8 @@ Test is as follows:
   - check that node0 and node1 have 5 transactions in their mempools
   - shutdown all nodes.
   - startup node0. Verify that it still has 5 transactions
-    in its mempool. Shutdown node0. This tests that by default the
-    mempool is persistent.
+    in its mempool and that it loaded its script caches. Shutdown node0.
+    This tests that by default the mempool is persistent.
   - startup node1. Verify that its mempool is empty. Shutdown node1.
     This tests that with -persistmempool=0, the mempool is not
     dumped to disk when the node is shut down.
@@ -89,10 +89,13 @@ class MempoolPersistTest(BitcoinTestFramework):
 
         self.log.debug("Stop-start the nodes. Verify that node0 has the transactions in its mempool and node1 does not. Verify that node2 calculates its balance correctly after loading wallet transactions.")
         self.stop_nodes()
+        assert os.path.isfile(os.path.join(self.nodes[0].datadir, self.chain, 'scriptcache.dat'))
+        assert not os.path.isfile(os.path.join(self.nodes[1].datadir, self.chain, 'scriptcache.dat'))
         # Give this node a head-start, so we can be "extra-sure" that it didn't load anything later
         # Also don't store the mempool, to keep the datadir clean
         self.start_node(1, extra_args=["-persistmempool=0"])
-        self.start_node(0)
+        with self.nodes[0].assert_debug_log(["Imported script caches from disk"]):
+            self.start_node(0)
         self.start_node(2)
         assert self.nodes[0].getmempoolinfo()["loaded"]  # start_node is blocking on the mempool being loaded
         assert self.nodes[2].getmempoolinfo()["loaded"]
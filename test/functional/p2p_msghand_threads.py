@@ -0,0 +1,56 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Rwa Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test processing peer messages on several message handler threads.
+
+Peers are spread across the threads by their id, while block and other
+chainstate-changing messages are still processed one at a time. Check that
+the messages of each peer are still processed in the order they were sent,
+also when serialized and unserialized messages are mixed.
+"""
+
+from test_framework.blocktools import create_block, create_coinbase
+from test_framework.messages import msg_block, msg_getaddr, msg_ping
+from test_framework.p2p import P2PInterface
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+NUM_PEERS = 8
+
+
+class MsgHandThreadsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [['-msghandthreads=4']]
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generatetoaddress(1, node.get_deterministic_priv_key().address)  # Get node out of IBD
+
+        self.log.info('Connect peers, which are spread across the message handler threads')
+        peers = [node.add_p2p_connection(P2PInterface()) for _ in range(NUM_PEERS)]
+        for peer in peers:
+            peer.send_and_ping(msg_getaddr())
+        assert_equal(len(node.getpeerinfo()), NUM_PEERS)
+
+        self.log.info('Check that a block sent before a ping is processed before the pong is sent')
+        for i in range(2 * NUM_PEERS):
+            tmpl = node.getblocktemplate({'rules': ['segwit']})
+            block = create_block(coinbase=create_coinbase(tmpl['height']), tmpl=tmpl)
+            block.solve()
+            peer = peers[i % NUM_PEERS]
+            peer.send_message(msg_block(block))
+            peer.send_message(msg_ping(nonce=i + 1))
+            peer.wait_until(lambda: peer.last_message.get('pong') is not None and peer.last_message['pong'].nonce == i + 1)
+            assert_equal(node.getbestblockhash(), block.hash)
+
+        self.log.info('Check that all peers are still connected')
+        for peer in peers:
+            peer.sync_with_ping()
+        assert_equal(len(node.getpeerinfo()), NUM_PEERS)
+
+
+if __name__ == '__main__':
+    MsgHandThreadsTest().main()
@@ -47,5 +47,12 @@ class DumptxoutsetTest(BitcoinTestFramework):
         assert_raises_rpc_error(
             -8, '{} already exists'.format(FILENAME),  node.dumptxoutset, FILENAME)
 
+        # A snapshot is only loaded on top of a shorter chain, and only at a
+        # height that has assumeutxo parameters.
+        assert_raises_rpc_error(
+            -8, "Couldn't open file", node.loadtxoutset, 'missing.dat')
+        assert_raises_rpc_error(
+            -32603, 'Unable to load UTXO snapshot', node.loadtxoutset, FILENAME)
+
 if __name__ == '__main__':
     DumptxoutsetTest().main()
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+# Copyright (c) 2021 The Rwa Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test that descriptor wallets rescan with block filters.
+
+A node with -blockfilterindex only reads the blocks whose filter matches the
+scriptPubKeys of a descriptor wallet, and must find the same transactions as
+a node without the index, which reads all blocks. The wallet pays to addresses
+beyond its keypool, so the rescan has to match against the scriptPubKeys the
+descriptors are topped up with on the way.
+"""
+import os
+import shutil
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal
+
+KEYPOOL_SIZE = 10
+NUM_BLOCKS = 6
+
+
+class WalletFastRescanTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [['-keypool={}'.format(KEYPOOL_SIZE), '-blockfilterindex'], ['-keypool={}'.format(KEYPOOL_SIZE)]]
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_wallet()
+        self.skip_if_no_sqlite()
+
+    def get_wallet_txs(self, wallet):
+        return sorted((tx['txid'], tx['vout'], tx['category'], tx['blockhash']) for tx in wallet.listtransactions('*', 1000))
+
+    def restore(self, node, backup):
+        wallet_dir = os.path.join(node.datadir, self.chain, 'wallets', 'restored')
+        os.mkdir(wallet_dir)
+        shutil.copyfile(backup, os.path.join(wallet_dir, 'wallet.dat'))
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.createwallet(wallet_name='funder', descriptors=True)
+        funder = node.get_wallet_rpc('funder')
+        node.generatetoaddress(101, funder.getnewaddress())
+
+        self.log.info("Back up a new wallet, then fund it beyond its keypool")
+        node.createwallet(wallet_name='topup_test', descriptors=True)
+        w = node.get_wallet_rpc('topup_test')
+        backup = os.path.join(self.options.tmpdir, 'topup_test.bak')
+        w.backupwallet(backup)
+        for i in range(NUM_BLOCKS):
+            # Receive on the last address of the keypool the wallet had at the
+            # previous transaction, and spend some of it to change addresses.
+            for _ in range(KEYPOOL_SIZE):
+                address = w.getnewaddress()
+            funder.sendtoaddress(address, 1)
+            node.generatetoaddress(1, funder.getnewaddress())
+            if i % 2:
+                w.sendtoaddress(funder.getnewaddress(), 0.1)
+            # Blocks with nothing for the wallet, whose filters do not match.
+            node.generatetoaddress(5, funder.getnewaddress())
+        self.sync_all()
+        expected_txs = self.get_wallet_txs(w)
+        assert_equal(len([tx for tx in expected_txs if tx[2] == 'receive']), NUM_BLOCKS)
+        height = node.getblockcount()
+        self.wait_until(lambda: node.getindexinfo('basic block filter index') == {'basic block filter index': {'synced': True, 'best_block_height': height}})
+
+        self.log.info("Restore the backup on both nodes, which rescans the blocks since it was made")
+        for n in self.nodes:
+            self.restore(n, backup)
+        with node.assert_debug_log(['skipped', 'whose block filter did not match the wallet']):
+            node.loadwallet('restored')
+        with self.nodes[1].assert_debug_log(['Rescan completed'], unexpected_msgs=['whose block filter did not match the wallet']):
+            self.nodes[1].loadwallet('restored')
+        for n in self.nodes:
+            assert_equal(self.get_wallet_txs(n.get_wallet_rpc('restored')), expected_txs)
+
+        self.log.info("Rescan the whole chain")
+        for n in self.nodes:
+            restored = n.get_wallet_rpc('restored')
+            restored.rescanblockchain()
+            assert_equal(self.get_wallet_txs(restored), expected_txs)
+            assert_equal(restored.getbalance(), w.getbalance())
+
+
+if __name__ == '__main__':
+    WalletFastRescanTest().main()